@@ -0,0 +1,78 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/clock.hpp
+ *
+ * @brief Time source injected into the core.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_CLOCK_HPP_
+#define KOBUKI_NODE_CLOCK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <time.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Where the core gets the host time from.
+ *
+ * Receive times and command timeouts are measured against it, so a ros node
+ * can plug in ros time (and with it simulated time), a benchmark or a
+ * supervisor a clock of its own.
+ */
+class Clock {
+public:
+  virtual ~Clock() {}
+
+  /**
+   * @return double : current time [s].
+   */
+  virtual double now() const = 0;
+};
+
+/**
+ * @brief The system's real time clock.
+ */
+class SystemClock : public Clock {
+public:
+  double now() const {
+    timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1.0e-9;
+  }
+};
+
+/**
+ * @brief A clock that only moves when told to, for deterministic runs.
+ */
+class ManualClock : public Clock {
+public:
+  ManualClock(const double &time = 0.0) : time(time) {}
+
+  double now() const { return time; }
+  void set(const double &new_time) { time = new_time; }
+  void advance(const double &duration) { time += duration; }
+
+private:
+  double time;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_CLOCK_HPP_ */
@@ -0,0 +1,198 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/command_latency.hpp
+ *
+ * @brief Tracing of velocity commands through the driver.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_COMMAND_LATENCY_HPP_
+#define KOBUKI_NODE_COMMAND_LATENCY_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include "spsc_queue.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Latency histogram with HDR style log-linear buckets.
+ *
+ * Latencies are counted in microseconds. Below 64us every value has its own
+ * bucket, above that each power of two is split in 32 buckets, so any value
+ * up to ~67s is known to within ~3%. Recording is a single atomic increment,
+ * so it is safe and lock-free from any thread.
+ */
+class LatencyHistogram {
+public:
+  static const unsigned int number_of_buckets = 704;
+
+  struct Summary {
+    Summary() : count(0), p50(0.0), p90(0.0), p99(0.0), max(0.0) {}
+    unsigned long count;
+    double p50, p90, p99, max; // [s]
+  };
+
+  LatencyHistogram();
+
+  void record(const double &latency); /**< @brief Add a latency [s]. **/
+  void reset();
+
+  /**
+   * @brief Copy of the bucket counts, consistent enough for reporting.
+   *
+   * @param counts : number_of_buckets counts to fill.
+   * @return unsigned long : total count.
+   */
+  unsigned long read(uint32_t *counts) const;
+
+  /**
+   * @brief Value of a quantile from counts given by read().
+   *
+   * @return double : middle of the bucket holding the quantile [s].
+   */
+  static double quantile(const uint32_t *counts, const unsigned long &total, const double &q);
+  static double bucketValue(const unsigned int &bucket); /**< @brief Lower bound of a bucket [s]. **/
+
+  Summary summary() const;
+
+  unsigned long count() const { return total.load(boost::memory_order_relaxed); }
+  double max() const { return maximum.load(boost::memory_order_relaxed) * 1.0e-6; } /**< @brief [s] **/
+
+private:
+  static unsigned int bucketIndex(const uint64_t &microseconds);
+
+  boost::atomic<uint32_t> buckets[number_of_buckets];
+  boost::atomic<unsigned long> total;
+  boost::atomic<uint64_t> maximum; // [us]
+};
+
+/**
+ * @brief Follows velocity commands from the subscriber to the wheels.
+ *
+ * Every command gets a tag and is timed, from its arrival in the velocity
+ * command callback, through these stages:
+ *
+ * - Applied : handed over to the driver with setBaseControl().
+ * - Sent : first base control command written to the serial port after it.
+ * - Motion : first stream packet whose odometry moved towards it.
+ *
+ * The subscriber thread hands the traces over to the driver thread through
+ * a lock-free ring. Motion is only timed for commands that step the target
+ * velocity by a measurable amount (repeating the same command moves
+ * nothing), one at a time.
+ *
+ * All times are host wall clock seconds.
+ */
+class CommandLatencyTracer {
+public:
+  enum Stage {
+    Applied = 0,
+    Sent = 1,
+    Motion = 2,
+    NumberOfStages = 3
+  };
+
+  CommandLatencyTracer();
+
+  static const char* stageName(const Stage &stage);
+
+  /**
+   * @brief Subscriber side, a command was handed to the driver.
+   *
+   * @param received : time the command callback was entered.
+   * @param applied : time setBaseControl() returned.
+   * @param linear : commanded linear velocity [m/s].
+   * @param angular : commanded angular velocity [rad/s].
+   * @return uint32_t : tag of the command.
+   */
+  uint32_t commandApplied(const double &received, const double &applied,
+                          const double &linear, const double &angular);
+
+  /**
+   * @brief Driver side, a base control command went out on the serial port.
+   */
+  void commandSent(const double &now);
+
+  /**
+   * @brief Driver side, odometry velocities from a stream packet.
+   */
+  void motionMeasured(const double &now, const double &linear, const double &angular);
+
+  const LatencyHistogram& histogram(const Stage &stage) const { return histograms[stage]; }
+  unsigned long commands() const { return tags.load(boost::memory_order_relaxed); }
+  unsigned long dropped() const { return pending.droppedCount(); }
+  unsigned long motionTimeouts() const { return motion_timeouts.load(boost::memory_order_relaxed); }
+
+private:
+  struct Trace {
+    Trace() : tag(0), received(0.0), linear(0.0), angular(0.0) {}
+    uint32_t tag;
+    double received;
+    double linear, angular;
+  };
+
+  LatencyHistogram histograms[NumberOfStages];
+  boost::atomic<uint32_t> tags;
+  SpscQueue<Trace> pending;  // applied, waiting to be sent
+
+  // driver thread only
+  Trace target;              // last command sent
+  Trace moving;              // step command waiting to show up in the odometry
+  bool awaiting_motion;
+  double baseline_linear, baseline_angular;    // odometry velocities when it was sent
+  double measured_linear, measured_angular;    // latest odometry velocities
+  boost::atomic<unsigned long> motion_timeouts;
+};
+
+/**
+ * @brief Age of stamped velocity commands, rejects the stale ones.
+ *
+ * A command that sat in a queue somewhere for longer than the maximum age
+ * is dropped instead of being executed as if it were fresh. The age of
+ * every command is kept in a histogram. Safe from any thread.
+ */
+class CommandAgeFilter {
+public:
+  CommandAgeFilter() : max_age(0.0), stale(0) {}
+
+  /**
+   * @param maximum_age : oldest command still executed [s], 0 for any.
+   */
+  void configure(const double &maximum_age) { max_age = maximum_age; }
+  double maximumAge() const { return max_age; }
+
+  /**
+   * @param age : time since the command was stamped [s].
+   * @return bool : false if it is stale.
+   */
+  bool accept(const double &age);
+
+  const LatencyHistogram& histogram() const { return ages; }
+  unsigned long staleCount() const { return stale.load(boost::memory_order_relaxed); }
+
+private:
+  LatencyHistogram ages;
+  double max_age; // fixed after init
+  boost::atomic<unsigned long> stale;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_COMMAND_LATENCY_HPP_ */
@@ -0,0 +1,80 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/command_timeout.hpp
+ *
+ * @brief Stops the base when the velocity commands stop coming in.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_COMMAND_TIMEOUT_HPP_
+#define KOBUKI_NODE_COMMAND_TIMEOUT_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include "clock.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Velocity command watchdog.
+ *
+ * Nothing times out before the first command. Not thread safe, guard
+ * commandReceived() and check() with the same lock.
+ */
+class CommandTimeout {
+public:
+  CommandTimeout(const Clock &clock) : clock(clock), period(0.6), last_command(-1.0), timed_out(false) {}
+
+  /**
+   * @param timeout : allowed time between commands [s].
+   */
+  void configure(const double &timeout) { period = timeout; }
+  double timeout() const { return period; }
+
+  void commandReceived() { last_command = clock.now(); }
+
+  bool expired() const { return (last_command >= 0.0) && ((clock.now() - last_command) > period); }
+
+  /**
+   * @brief Check for the timeout, once per stream packet.
+   *
+   * @param enabled : whether the motors are enabled, nothing to stop otherwise.
+   * @return bool : true only on the check that found it expired first, so
+   *                the base gets stopped (and the warning logged) once.
+   */
+  bool check(const bool &enabled) {
+    if ( !enabled || !expired() ) {
+      timed_out = false;
+      return false;
+    }
+    if ( timed_out ) {
+      return false;
+    }
+    timed_out = true;
+    return true;
+  }
+
+private:
+  const Clock &clock;
+  double period;
+  double last_command;
+  bool timed_out; // stops the warning spam while it stays timed out
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_COMMAND_TIMEOUT_HPP_ */
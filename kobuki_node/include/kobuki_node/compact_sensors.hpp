@@ -0,0 +1,156 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/compact_sensors.hpp
+ *
+ * @brief Compact binary encoding of the kobuki core sensors.
+ *
+ * Standalone (no ros, no driver) so remote dashboards can decode the
+ * sensors/core_compact topic by linking only kobuki_compact_sensors.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_COMPACT_SENSORS_HPP_
+#define KOBUKI_NODE_COMPACT_SENSORS_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Core sensors, cliff, current and gp input of one stream packet.
+ *
+ * Same content and units as kobuki_msgs/SensorState.
+ */
+struct CompactSensorState {
+  CompactSensorState();
+
+  uint16_t time_stamp; // firmware time stamp [ms]
+  uint8_t bumper;
+  uint8_t wheel_drop;
+  uint8_t cliff;
+  uint8_t buttons;
+  uint16_t left_encoder;
+  uint16_t right_encoder;
+  int8_t left_pwm;
+  int8_t right_pwm;
+  uint8_t charger;
+  uint8_t battery;
+  uint8_t over_current;
+  uint16_t bottom[3];
+  uint8_t current[2];
+  uint16_t digital_input;
+  uint16_t analog_input[4];
+};
+
+/**
+ * @brief Byte layout of an encoded frame.
+ *
+ * All multi-byte values are little endian.
+ *
+ * @code
+ * byte 0     : format version
+ * byte 1     : flags (bit 0 set for key frames)
+ * byte 2-3   : frame sequence number
+ * byte 4-5   : field mask, bit n set if field n follows
+ * byte 6-... : the fields present in the mask, in field order
+ * @endcode
+ *
+ * Key frames carry every field, so they always have the same size. Delta
+ * frames only carry the fields that changed since the previous frame.
+ */
+namespace CompactSensorFormat {
+enum Field {
+  TimeStamp   = 0, // time_stamp                          2 bytes
+  Events      = 1, // bumper, wheel_drop, cliff, buttons  4 bytes
+  Encoders    = 2, // left_encoder, right_encoder         4 bytes
+  Pwm         = 3, // left_pwm, right_pwm                 2 bytes
+  Power       = 4, // charger, battery, over_current      3 bytes
+  CliffBottom = 5, // bottom[3]                           6 bytes
+  Current     = 6, // current[2]                          2 bytes
+  DigitalIn   = 7, // digital_input                       2 bytes
+  AnalogIn    = 8, // analog_input[4]                     8 bytes
+  NumberOfFields = 9
+};
+const uint8_t version = 1;
+const uint8_t key_frame_flag = 0x01;
+const size_t header_size = 6;
+const size_t max_frame_size = header_size + 2 + 4 + 4 + 2 + 3 + 6 + 2 + 2 + 8;
+} // namespace CompactSensorFormat
+
+/**
+ * @brief Encodes sensor states into compact frames.
+ *
+ * Sends a key frame every key_frame_interval frames (and for the first one)
+ * so that late joiners and receivers that lost a frame can resynchronise.
+ */
+class CompactSensorEncoder {
+public:
+  CompactSensorEncoder(const unsigned int &key_frame_interval = 50);
+
+  /**
+   * @brief Encode a state.
+   *
+   * @param state : the state to encode.
+   * @param buffer : at least CompactSensorFormat::max_frame_size bytes.
+   * @return size_t : number of bytes written.
+   */
+  size_t encode(const CompactSensorState &state, uint8_t *buffer);
+
+  void requestKeyFrame() { frames_to_key_frame = 0; }
+
+private:
+  unsigned int key_frame_interval;
+  unsigned int frames_to_key_frame;
+  uint16_t sequence;
+  CompactSensorState previous;
+};
+
+/**
+ * @brief Decodes compact frames back into sensor states.
+ */
+class CompactSensorDecoder {
+public:
+  CompactSensorDecoder();
+
+  /**
+   * @brief Decode a frame.
+   *
+   * Delta frames are applied on top of the previously decoded state, so they
+   * are only accepted if no frame was lost since the last key frame.
+   *
+   * @param buffer : encoded frame.
+   * @param size : size of the encoded frame.
+   * @param state : decoded state, only valid if returning true.
+   * @return bool : false if malformed or waiting for a key frame to resync.
+   */
+  bool decode(const uint8_t *buffer, const size_t &size, CompactSensorState &state);
+
+  unsigned long lostFrames() const { return lost_frames; }
+
+private:
+  bool synchronised;
+  uint16_t sequence;
+  unsigned long lost_frames;
+  CompactSensorState current;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_COMPACT_SENSORS_HPP_ */
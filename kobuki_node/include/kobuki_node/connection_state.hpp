@@ -0,0 +1,89 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/connection_state.hpp
+ *
+ * @brief Book keeping for reconnecting to the kobuki.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_CONNECTION_STATE_HPP_
+#define KOBUKI_NODE_CONNECTION_STATE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Connection state machine with exponential backoff.
+ *
+ * Connected until the connection is declared lost, then attempts are due
+ * right away and after each failure the wait doubles, up to the maximum
+ * backoff. Also keeps the reconnect and downtime statistics.
+ *
+ * All times are in seconds.
+ */
+class ConnectionState {
+public:
+  ConnectionState(const double &initial_backoff = 0.5, const double &max_backoff = 30.0);
+
+  void configure(const double &initial_backoff, const double &max_backoff);
+
+  void connected(const double &now);
+  void disconnected(const double &now);
+  void attemptFailed(const double &now);
+  void alive(const double &now) { last_alive = now; }
+
+  bool isConnected() const { return is_connected; }
+  bool attemptDue(const double &now) const { return !is_connected && (now >= next_attempt); }
+  double silence(const double &now) const { return now - last_alive; } /**< @brief Time since the stream was last seen alive. **/
+  double nextAttempt(const double &now) const { return is_connected ? 0.0 : next_attempt - now; }
+  double downtime(const double &now) const { return is_connected ? 0.0 : now - down_since; }
+  double lastDowntime() const { return last_downtime; }
+  double totalDowntime() const { return total_downtime; }
+  unsigned int reconnects() const { return (connections > 0) ? connections - 1 : 0; }
+  unsigned int failedAttempts() const { return failed_attempts; }
+
+private:
+  double initial_backoff, max_backoff;
+  double backoff;
+  bool is_connected;
+  double last_alive;
+  double down_since;
+  double next_attempt;
+  double last_downtime;
+  double total_downtime;
+  unsigned int connections;
+  unsigned int failed_attempts;
+};
+
+/**
+ * @brief Resolve a device port to the device node it currently points at.
+ *
+ * Udev symlinks (e.g. /dev/kobuki) are re-resolved on every call, so a base
+ * that re-enumerates as another ttyUSB is found again.
+ *
+ * @param port : configured device port.
+ * @param resolved : device node it resolves to.
+ * @return bool : false if it doesn't exist (right now).
+ */
+bool resolveDevicePort(const std::string &port, std::string &resolved);
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_CONNECTION_STATE_HPP_ */
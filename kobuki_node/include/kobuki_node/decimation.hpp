@@ -0,0 +1,123 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/decimation.hpp
+ *
+ * @brief Rate decimation and windowed aggregation of the stream topics.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_DECIMATION_HPP_
+#define KOBUKI_NODE_DECIMATION_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <stdint.h>
+#include "stream_snapshot.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Decides which stream packets close a publishing window.
+ *
+ * With a zero rate every packet closes a window. Otherwise the first packet
+ * is published right away and then one every period, following the packet
+ * stamps (not the host clock) so the windows always hold the same number
+ * of packets.
+ */
+class Decimator {
+public:
+  Decimator() : period(0.0), next_window(0.0), started(false) {}
+
+  void init(const double &rate) { period = (rate > 0.0) ? 1.0 / rate : 0.0; reset(); }
+  void reset() { started = false; }
+  bool decimating() const { return period > 0.0; }
+
+  /**
+   * @brief Register a packet.
+   *
+   * @param stamp : packet stamp [s].
+   * @return bool : true if the window is complete and should be published.
+   */
+  bool update(const double &stamp);
+
+private:
+  double period;
+  double next_window;
+  bool started;
+};
+
+/**
+ * @brief Aggregates the core sensors over a decimation window.
+ *
+ * Event like bits (bumpers, cliffs, wheel drops, buttons, over current) are
+ * or'ed so short events are never lost. sensors/core has room for a single
+ * value per cliff sensor and motor, so only the safety relevant extreme is
+ * kept: the minimum cliff reading (closest to seeing a cliff) and the
+ * maximum current (closest to stalling). Everything else is taken from the
+ * packet closing the window.
+ */
+class SensorStateWindow {
+public:
+  SensorStateWindow() : samples(0), bumper(0), wheel_drop(0), cliff(0), buttons(0), over_current(0) {}
+
+  void reset() { samples = 0; }
+  void add(const StreamSnapshot &snapshot);
+
+  unsigned int samples;
+  uint8_t bumper, wheel_drop, cliff, buttons, over_current;
+  std::vector<uint16_t> bottom_min;
+  std::vector<uint8_t> current_max;
+};
+
+/**
+ * @brief Averages the gyro rates over a decimation window.
+ */
+class InertiaWindow {
+public:
+  InertiaWindow() : samples(0), angular_velocity_sum(0.0) {}
+
+  void reset() { samples = 0; angular_velocity_sum = 0.0; }
+  void add(const StreamSnapshot &snapshot) { ++samples; angular_velocity_sum += snapshot.angular_velocity; }
+  double angularVelocity() const { return (samples > 0) ? angular_velocity_sum / samples : 0.0; }
+
+  unsigned int samples;
+  double angular_velocity_sum;
+};
+
+/**
+ * @brief Or's the docking signals seen by each sensor over a decimation window.
+ */
+class DockIRWindow {
+public:
+  DockIRWindow() : samples(0) { docking[0] = docking[1] = docking[2] = 0; }
+
+  void reset() { samples = 0; docking[0] = docking[1] = docking[2] = 0; }
+  void add(const StreamSnapshot &snapshot) {
+    ++samples;
+    for ( unsigned int i = 0; i < 3; ++i ) {
+      docking[i] |= snapshot.dock_ir.docking[i];
+    }
+  }
+
+  unsigned int samples;
+  uint8_t docking[3];
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_DECIMATION_HPP_ */
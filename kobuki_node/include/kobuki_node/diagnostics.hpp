@@ -21,6 +21,11 @@
 #include <kobuki_driver/modules/battery.hpp>
 #include <kobuki_driver/packets/core_sensors.hpp>
 #include <diagnostic_updater/diagnostic_updater.h>
+#include "command_latency.hpp"
+#include "connection_state.hpp"
+#include "startup_monitor.hpp"
+#include "stream_health.hpp"
+#include "thread_scheduling.hpp"
 
 /*****************************************************************************
 ** Namespaces
@@ -168,6 +173,131 @@ private:
   std::vector<uint16_t> values;
 };
 
+/**
+ * Diagnostic checking the backlog of the stream data publishing thread.
+ */
+class PublishQueueTask : public diagnostic_updater::DiagnosticTask {
+public:
+  PublishQueueTask() : DiagnosticTask("Publish Queue"),
+    threaded(false), depth(0), capacity(0), dropped(0), last_dropped(0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(bool is_threaded, unsigned int new_depth, unsigned int new_capacity, unsigned long new_dropped) {
+    threaded = is_threaded; depth = new_depth; capacity = new_capacity; dropped = new_dropped;
+  }
+
+private:
+  bool threaded;
+  unsigned int depth;
+  unsigned int capacity;
+  unsigned long dropped;
+  unsigned long last_dropped;
+};
+
+/**
+ * Diagnostic checking the health of the serial stream: packet rate,
+ * inter-arrival jitter, lost packets and firmware vs host clock.
+ *
+ * Packets are registered from the driver thread as they arrive, statistics
+ * are those of the packets seen since the previous run, so a degrading link
+ * (e.g. an overloaded usb hub) shows up before the watchdog trips.
+ */
+class StreamHealthTask : public diagnostic_updater::DiagnosticTask {
+public:
+  StreamHealthTask(StreamHealth &health) : DiagnosticTask("Stream Health"), health(health) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+
+private:
+  StreamHealth &health; // each run reports and restarts its window
+  StreamHealthReport report;
+};
+
+/**
+ * Diagnostic reporting the velocity command latencies, from the command
+ * callback to the driver, the serial port and the wheels.
+ */
+class CommandLatencyTask : public diagnostic_updater::DiagnosticTask {
+public:
+  CommandLatencyTask() : DiagnosticTask("Command Latency"),
+    commands(0), dropped(0), last_dropped(0), motion_timeouts(0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const CommandLatencyTracer &tracer);
+
+private:
+  LatencyHistogram::Summary stages[CommandLatencyTracer::NumberOfStages];
+  unsigned long commands;
+  unsigned long dropped;
+  unsigned long last_dropped;
+  unsigned long motion_timeouts;
+};
+
+/**
+ * Diagnostic reporting the age of stamped velocity commands on arrival.
+ */
+class CommandAgeTask : public diagnostic_updater::DiagnosticTask {
+public:
+  CommandAgeTask() : DiagnosticTask("Command Age"), maximum_age(0.0), stale(0), last_stale(0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const CommandAgeFilter &filter);
+
+private:
+  LatencyHistogram::Summary ages;
+  double maximum_age;
+  unsigned long stale;
+  unsigned long last_stale;
+};
+
+/**
+ * Diagnostic reporting the scheduling applied to each of our threads.
+ */
+class SchedulingTask : public diagnostic_updater::DiagnosticTask {
+public:
+  SchedulingTask() : DiagnosticTask("Scheduling"), configured(false), succeeded(true) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(ThreadScheduling &scheduling) {
+    configured = scheduling.configured();
+    succeeded = scheduling.report(outcomes);
+  }
+
+private:
+  bool configured;
+  bool succeeded;
+  std::vector<std::pair<std::string, std::string> > outcomes;
+};
+
+/**
+ * Diagnostic reporting the serial connection and the reconnections.
+ */
+class ConnectionTask : public diagnostic_updater::DiagnosticTask {
+public:
+  ConnectionTask() : DiagnosticTask("Connection"),
+    connected(false), reconnects(0), failed_attempts(0),
+    downtime(0.0), last_downtime(0.0), total_downtime(0.0), next_attempt(0.0),
+    time_to_stream(-1.0), time_to_version(-1.0) {}
+  void run(diagnostic_updater::DiagnosticStatusWrapper &stat);
+  void update(const ConnectionState &connection, const StartupMonitor &startup,
+              const double &now, const std::string &device_port) {
+    connected = connection.isConnected();
+    port = device_port;
+    reconnects = connection.reconnects();
+    failed_attempts = connection.failedAttempts();
+    downtime = connection.downtime(now);
+    last_downtime = connection.lastDowntime();
+    total_downtime = connection.totalDowntime() + downtime;
+    next_attempt = connection.nextAttempt(now);
+    time_to_stream = startup.timeToStream();
+    time_to_version = startup.timeToVersion();
+  }
+
+private:
+  bool connected;
+  std::string port;
+  unsigned int reconnects;
+  unsigned int failed_attempts;
+  double downtime, last_downtime, total_downtime;
+  double next_attempt;
+  double time_to_stream, time_to_version; // negative until received
+};
+
 } // namespace kobuki
 
 #endif /* KOBUKI_NODE_DIAGNOSTICS_HPP_ */
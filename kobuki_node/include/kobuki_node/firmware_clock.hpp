@@ -0,0 +1,104 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/firmware_clock.hpp
+ *
+ * @brief Maps the firmware millisecond clock onto host time.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_FIRMWARE_CLOCK_HPP_
+#define KOBUKI_NODE_FIRMWARE_CLOCK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Online model of the firmware clock against the host clock.
+ *
+ * Every stream packet carries the 16 bit firmware time stamp in milliseconds
+ * (it wraps every ~65 seconds). The host receives it some variable transport
+ * and scheduling delay later, so the offset host - firmware is only ever over
+ * estimated. The model unwraps the firmware clock and tracks the lower envelope
+ * of that offset: the minimum over fixed windows is filtered into an offset
+ * and a skew (relative drift of the two clocks), so the resulting stamps are
+ * free of the receive jitter.
+ *
+ * Large disagreements resynchronise the offset: a packet arriving long
+ * before the model expects it (firmware reboot) on the spot, packets
+ * arriving long after it (host clock stepped forward, stream stalled for
+ * longer than a wrap around) after a few in a row, so a single delayed
+ * packet doesn't.
+ *
+ * All times are in seconds.
+ */
+class FirmwareClock {
+public:
+  FirmwareClock(const double &window_length = 2.0, const double &resync_threshold = 0.5);
+
+  /**
+   * @brief Update the model with a new packet and convert its stamp.
+   *
+   * @param firmware_stamp : firmware time stamp of the packet [ms].
+   * @param host_time : host time at which the packet was received.
+   * @return double : host time at which the firmware stamped the packet.
+   */
+  double update(const uint16_t &firmware_stamp, const double &host_time);
+
+  /**
+   * @brief Forget everything, the next packet starts a new model.
+   */
+  void reset() { initialised = false; }
+
+  bool isInitialised() const { return initialised; }
+  double offset() const { return estimatedOffset(firmware_time); } /**< @brief Current host - firmware offset. */
+  double skew() const { return drift; }                            /**< @brief Drift of host vs firmware clock [s/s]. */
+  double firmwareTime() const { return firmware_time; }            /**< @brief Unwrapped firmware time of the last packet. */
+  double lastDelay() const { return last_delay; }                  /**< @brief Receive delay of the last packet w.r.t. the model. */
+  unsigned int resyncs() const { return resync_count; }            /**< @brief Resynchronisations, not counting the first packet. */
+
+private:
+  double estimatedOffset(const double &time) const { return reference_offset + drift * (time - reference_time); }
+  void resync(const double &raw_offset);
+  void restart(const double &raw_offset);
+
+  const double window_length;
+  const double resync_threshold;
+
+  bool initialised;
+  uint16_t last_stamp;
+  uint64_t unwrapped_stamp; // [ms]
+  double firmware_time;
+
+  // offset line: reference_offset at reference_time, sloping with drift
+  double reference_time;
+  double reference_offset;
+  double drift;
+  bool has_window;          // at least one window folded into the line
+
+  double window_start;
+  double window_minimum;
+  double last_delay;
+  unsigned int late_packets; // in a row, more than resync_threshold behind the model
+  unsigned int resync_count;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_FIRMWARE_CLOCK_HPP_ */
@@ -0,0 +1,180 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/kobuki_core.hpp
+ *
+ * @brief Ros free processing of the kobuki sensor stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_KOBUKI_CORE_HPP_
+#define KOBUKI_NODE_KOBUKI_CORE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include <kobuki_driver/kobuki.hpp>
+#include "clock.hpp"
+#include "command_timeout.hpp"
+#include "compact_sensors.hpp"
+#include "decimation.hpp"
+#include "firmware_clock.hpp"
+#include "odometry_model.hpp"
+#include "raw_replay.hpp"
+#include "stream_health.hpp"
+#include "stream_sink.hpp"
+#include "stream_snapshot.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Settings of the core.
+ */
+struct CoreParameters {
+  CoreParameters();
+
+  bool use_firmware_clock; // stamp with the firmware clock instead of the receive time
+  bool use_imu_heading;    // odometry heading from the gyro instead of the encoders
+  double command_timeout;  // stop the base when velocity commands stop for this long [s]
+  // publishing rates, 0 for every packet [Hz]
+  double sensor_state_rate, joint_state_rate, dock_ir_rate, inertia_rate, odometry_rate;
+  unsigned int compact_key_frame_interval;
+};
+
+/**
+ * @brief Everything the node makes of the sensor stream, without ros.
+ *
+ * Stamps the packets, integrates the odometry, decimates and aggregates the
+ * stream outputs, converts the raw gyro data, tracks the hazard transitions,
+ * the command timeout and the stream health, and hands the results to a
+ * StreamSink. The host time comes from the injected Clock.
+ *
+ * Driver events (buttons, bumpers, ...) don't go through here, they come
+ * ready made from the driver's signals.
+ *
+ * Threading follows the driver: capture(), integrate(), processHazards() and
+ * the command timeout belong to the driver thread, process() to one other thread (or
+ * the driver thread too). reconnected() and replay() must only be called
+ * while no driver thread is running.
+ */
+class KobukiCore {
+public:
+  KobukiCore(const Clock &clock);
+
+  void init(const CoreParameters &parameters);
+  const CoreParameters& parameters() const { return config; }
+
+  /**
+   * @brief A new driver, a new odometry and maybe a rebooted firmware.
+   */
+  void reconnected();
+
+  /**
+   * @brief Stamp deterministically from the recording being replayed.
+   *
+   * @param start_time : recorded host time of the first packet [s].
+   * @param start_stamp : its firmware time stamp [ms].
+   */
+  void replay(const double &start_time, const uint16_t &start_stamp);
+
+  /**
+   * @brief Copy the latest driver data into a snapshot, stamp and integrate it.
+   *
+   * Call from the driver's stream data slot, the only place where the
+   * driver's data can't change underneath and its odometry gets updated.
+   */
+  void capture(Kobuki &kobuki, StreamSnapshot &snapshot);
+
+  /**
+   * @brief Stamp a snapshot received at snapshot.receive_time.
+   *
+   * Done by capture(), separate for snapshots that don't come from a driver.
+   */
+  void stamp(StreamSnapshot &snapshot);
+
+  /**
+   * @brief Integrate a stamped snapshot's pose update into the odometry.
+   *
+   * The result goes into snapshot.odometry. Done by capture() in the driver
+   * thread, so no pose update is lost with snapshots the publishing thread
+   * drops; process() only publishes it.
+   */
+  void integrate(StreamSnapshot &snapshot);
+
+  /**
+   * @brief Deliver a hazard transition, if the snapshot has one.
+   *
+   * Transitions are rare and must not be lost with dropped snapshots, so
+   * this runs for every captured snapshot in the driver thread.
+   */
+  void processHazards(const StreamSnapshot &snapshot, StreamSink &sink);
+
+  /**
+   * @brief Fan a snapshot out to the stream outputs.
+   */
+  void process(const StreamSnapshot &snapshot, StreamSink &sink);
+
+  void resetOdometry() { odometry.reset(); }
+
+  CommandTimeout& commandTimeout() { return command_timeout; }
+  StreamHealth& streamHealth() { return stream_health; }
+  const FirmwareClock& firmwareClock() const { return firmware_clock; }
+  const OdometryState& odometryState() const { return odometry.state(); }
+
+  /**
+   * @brief Convert a raw gyro packet into rates in the robot's frame.
+   *
+   * @param data : raw gyro packet.
+   * @param stamp : of the packet [s], that of the last sample.
+   * @param samples : converted samples.
+   */
+  static void convertRawInertia(const ThreeAxisGyro::Data &data, const double &stamp, RawInertiaSamples &samples);
+
+private:
+  void processWheelState(const StreamSnapshot &snapshot, StreamSink &sink);
+  void processSensorState(const StreamSnapshot &snapshot, StreamSink &sink);
+  void processCompactSensorState(const StreamSnapshot &snapshot, StreamSink &sink);
+  void processInertia(const StreamSnapshot &snapshot, StreamSink &sink);
+  void processRawInertia(const StreamSnapshot &snapshot, StreamSink &sink);
+  void processDockIR(const StreamSnapshot &snapshot, StreamSink &sink);
+
+  const Clock &clock;
+  CoreParameters config;
+
+  // driver thread
+  FirmwareClock firmware_clock;
+  ReplayClock replay_clock;
+  bool replaying;
+  StreamHealth stream_health;
+  CommandTimeout command_timeout;
+  HazardTransition hazards;
+  bool hazards_published; // at least one transition delivered
+
+  // processing thread
+  OdometryModel odometry;
+  Decimator sensor_state_decimator, joint_state_decimator, dock_ir_decimator, inertia_decimator, odometry_decimator;
+  SensorStateWindow sensor_state_window;
+  DockIRWindow dock_ir_window;
+  InertiaWindow inertia_window;
+  CompactSensorEncoder compact_sensor_encoder;
+  CompactSensorState compact_sensor_state;
+  uint8_t compact_frame[CompactSensorFormat::max_frame_size];
+  RawInertiaSamples raw_inertia_samples;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_KOBUKI_CORE_HPP_ */
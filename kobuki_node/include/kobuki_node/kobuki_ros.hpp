@@ -45,16 +45,26 @@
  *****************************************************************************/
 
 #include <string>
+#include <boost/atomic.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <angles/angles.h>
+#include <geometry_msgs/TwistStamped.h>
 #include <std_msgs/Empty.h>
 #include <std_msgs/String.h>
 #include <std_msgs/Int16MultiArray.h>
+#include <std_msgs/UInt8MultiArray.h>
 #include <sensor_msgs/JointState.h>
 #include <sensor_msgs/Imu.h>
 #include <ecl/sigslots.hpp>
+#include <ecl/threads/thread.hpp>
 #include <kobuki_msgs/ButtonEvent.h>
 #include <kobuki_msgs/BumperEvent.h>
 #include <kobuki_msgs/CliffEvent.h>
@@ -72,8 +82,25 @@
 #include <kobuki_msgs/VersionInfo.h>
 #include <kobuki_msgs/WheelDropEvent.h>
 #include <kobuki_driver/kobuki.hpp>
+#include <kobuki_node/CommandLatency.h>
+#include <kobuki_node/HazardState.h>
+#include <kobuki_node/RawGyroBatch.h>
+#include "command_latency.hpp"
+#include "compact_sensors.hpp"
+#include "connection_state.hpp"
 #include "diagnostics.hpp"
+#include "kobuki_core.hpp"
+#include "lazy_publisher.hpp"
+#include "message_pool.hpp"
 #include "odometry.hpp"
+#include "raw_recording.hpp"
+#include "raw_replay.hpp"
+#include "startup_monitor.hpp"
+#include "stream_sink.hpp"
+#include "stream_snapshot.hpp"
+#include "thread_scheduling.hpp"
+#include "velocity_mux.hpp"
+#include "velocity_smoother.hpp"
 
 /*****************************************************************************
  ** Namespaces
@@ -81,13 +108,36 @@
 
 namespace kobuki
 {
-class KobukiRos
+
+/**
+ * @brief The driver, heap allocated so it can be recreated on reconnection.
+ */
+class KobukiDriver : public Kobuki
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief Ros time (and with it simulated time) for the core.
+ */
+class RosClock : public Clock
+{
+public:
+  double now() const { return ros::Time::now().toSec(); }
+};
+
+/**
+ * @brief Ros adapter of the core, publishes what it makes of the stream.
+ */
+class KobukiRos : public StreamSink
 {
 public:
   KobukiRos(std::string& node_name);
   ~KobukiRos();
   bool init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub);
   bool update();
+  void configureThread(const std::string &thread_name) { thread_scheduling.apply(thread_name); }
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 private:
@@ -95,33 +145,129 @@ private:
    ** Variables
    **********************/
   std::string name; // name of the ROS node
-  Kobuki kobuki;
-  sensor_msgs::JointState joint_states;
+
+  /*********************
+   ** Connection
+   **********************/
+  // replaced on reconnection by the update thread, which holds the mutex
+  // exclusively meanwhile; everyone else only try-locks it shared and skips
+  // the driver when that fails, so the old driver thread can always finish
+  typedef boost::shared_lock<boost::shared_mutex> DriverLock;
+  boost::scoped_ptr<KobukiDriver> kobuki;
+  boost::shared_mutex driver_mutex;
+  Parameters parameters;   // driver parameters as configured
+  std::string device_port; // what the configured port resolved to on connection
+  ConnectionState connection;
+  StartupMonitor startup;  // signalled by the driver thread once a new driver is ready
+  double stream_timeout;   // reconnect when the stream is dead for this long, 0 to never
+  bool motors_enabled;     // restored on reconnection
+
+  bool driverAvailable(const DriverLock &lock) const { return lock.owns_lock() && kobuki; }
+  bool connect();
+  void disconnect();
+  void updateConnection();
+
+  RosClock clock;
+  KobukiCore core; // all the stream processing, we only publish its results
+  StreamSnapshotBuffer stream_snapshots; // written by the stream data slot
+  StreamSnapshot diagnostics_snapshot;   // copy read by the update loop
+  sensor_msgs::JointState joint_states; // prototype for the joint state pool
   Odometry odometry;
-  bool cmd_vel_timed_out_; // stops warning spam when cmd_vel flags as timed out more than once in a row
+  boost::mutex base_control_mutex; // velocity commands vs the timeout check in the driver thread
+  VelocitySmoother velocity_smoother; // guarded by the base_control_mutex, stepped by the driver thread
   bool serial_timed_out_; // stops warning spam when serial connection timed out more than once in a row
+  CommandLatencyTracer command_latency;
+  CommandAgeFilter command_age; // of commands/velocity_stamped
+  ThreadScheduling thread_scheduling;
+  bool driver_thread_configured; // scheduling applied from within the driver thread
+  ros::WallTime last_command_latency_report;
+
+  /*********************
+   ** Raw Recording
+   **********************/
+  RawRecorder raw_recorder;
+  boost::mutex raw_recorder_mutex; // commands are sent from any thread, stream packets from the driver's
+  bool record_raw;                 // fixed after init
+  uint16_t raw_firmware_stamp;     // of the last stream packet, commands are stamped with it
+
+  /*********************
+   ** Replay
+   **********************/
+  RawReplay raw_replay;      // stands in for the kobuki on a pseudo terminal
+  ecl::Thread replay_thread;
+  bool replaying;
+  bool replay_finished;
+
+  /*********************
+   ** Publishing Thread
+   **********************/
+  StreamSnapshotQueue publish_queue; // snapshots waiting for the publishing thread
+  ecl::Thread publish_thread;
+  bool publish_threaded; // false if publishing straight from the driver thread
+  boost::atomic<bool> shutdown_requested; // also polled outside the publish_mutex
+  boost::mutex publish_mutex;
+  boost::condition_variable publish_condition;
+
+  void publishLoop();
 
   /*********************
    ** Ros Comms
    **********************/
   ros::Publisher version_info_publisher, controller_info_publisher;
-  ros::Publisher imu_data_publisher, sensor_state_publisher, joint_state_publisher, dock_ir_publisher, raw_imu_data_publisher;
+  LazyPublisher imu_data_publisher, sensor_state_publisher, joint_state_publisher, dock_ir_publisher, raw_imu_data_publisher;
+  LazyPublisher compact_sensor_publisher, raw_gyro_batch_publisher;
+  LazyPublisher command_latency_publisher;
   ros::Publisher button_event_publisher, input_event_publisher, robot_event_publisher;
   ros::Publisher bumper_event_publisher, cliff_event_publisher, wheel_event_publisher, power_event_publisher;
   ros::Publisher raw_data_command_publisher, raw_data_stream_publisher, raw_control_command_publisher;
+  ros::Publisher hazard_state_publisher;
+
+  MessagePool<kobuki_msgs::SensorState> sensor_state_pool;
+  MessagePool<sensor_msgs::JointState> joint_state_pool;
+  MessagePool<kobuki_msgs::DockInfraRed> dock_ir_pool;
+  MessagePool<sensor_msgs::Imu> imu_data_pool, raw_imu_data_pool;
+  MessagePool<std_msgs::UInt8MultiArray> compact_sensor_pool;
+  MessagePool<kobuki_node::RawGyroBatch> raw_gyro_batch_pool;
+  MessagePool<kobuki_node::HazardState> hazard_state_pool; // driver thread
 
-  ros::Subscriber velocity_command_subscriber, digital_output_command_subscriber, external_power_command_subscriber;
+  /*********************
+   ** Command Queue
+   **********************/
+  // velocity and motor power commands, serviced by their own spinner so that
+  // cosmetic commands (leds, sounds, ...) queueing up can't delay a stop
+  ros::CallbackQueue command_queue;
+  ros::AsyncSpinner command_spinner;
+
+  ros::Subscriber velocity_command_subscriber, velocity_stamped_command_subscriber;
+  ros::Subscriber digital_output_command_subscriber, external_power_command_subscriber;
+  std::vector<ros::Subscriber> velocity_mux_subscribers;
   ros::Subscriber controller_info_command_subscriber;
   ros::Subscriber led1_command_subscriber, led2_command_subscriber, sound_command_subscriber;
   ros::Subscriber motor_power_subscriber, reset_odometry_subscriber;
 
+  /*********************
+   ** Velocity Mux
+   **********************/
+  // prioritized velocity inputs, replaces commands/velocity when configured
+  VelocityMux velocity_mux; // guarded by the base_control_mutex
+  ros::Publisher velocity_mux_active_publisher;
+  std::vector<std_msgs::StringPtr> velocity_mux_active_names; // per input and idle last, prebuilt
+
+  bool configureVelocityMux(ros::NodeHandle& nh);
+  void publishActiveVelocityInput(const int &input);
+
   void advertiseTopics(ros::NodeHandle& nh);
   void subscribeTopics(ros::NodeHandle& nh);
+  void initMessagePools();
+  void publishCommandLatency();
 
   /*********************
   ** Ros Callbacks
   **********************/
   void subscribeVelocityCommand(const geometry_msgs::TwistConstPtr);
+  void subscribeVelocityStampedCommand(const geometry_msgs::TwistStampedConstPtr);
+  void subscribeMuxVelocityCommand(const geometry_msgs::TwistConstPtr, const unsigned int input);
+  void applyVelocityCommand(const geometry_msgs::Twist &msg, const int &mux_input);
   void subscribeLed1Command(const kobuki_msgs::LedConstPtr);
   void subscribeLed2Command(const kobuki_msgs::LedConstPtr);
   void subscribeDigitalOutputCommand(const kobuki_msgs::DigitalOutputConstPtr);
@@ -154,11 +300,8 @@ private:
    ** Slot Callbacks
    **********************/
   void processStreamData();
-  void publishWheelState();
-  void publishInertia();
-  void publishRawInertia();
-  void publishSensorState();
-  void publishDockIRData();
+  void checkCommandTimeout();
+  void stepVelocitySmoother(const StreamSnapshot &snapshot);
   void publishVersionInfo(const VersionInfo &version_info);
   void publishControllerInfo();
   void publishButtonEvent(const ButtonEvent &event);
@@ -175,6 +318,20 @@ private:
   void rosInfo(const std::string &msg) { ROS_INFO_STREAM("Kobuki : " << msg); }
   void rosWarn(const std::string &msg) { ROS_WARN_STREAM("Kobuki : " << msg); }
   void rosError(const std::string &msg) { ROS_ERROR_STREAM("Kobuki : " << msg); }
+  /*********************
+   ** Stream Sink
+   **********************/
+  bool subscribed(const StreamOutput::Type &output) const;
+  void publishSensorState(const StreamSnapshot &snapshot, const SensorStateWindow &window);
+  void publishCompactSensorState(const uint8_t *frame, const size_t &size);
+  void publishJointState(const StreamSnapshot &snapshot);
+  void publishInertia(const StreamSnapshot &snapshot, const InertiaWindow &window);
+  void publishRawInertia(const RawInertiaSamples &samples);
+  void publishDockIR(const StreamSnapshot &snapshot, const DockIRWindow &window);
+  void publishOdometry(const OdometryState &state) { odometry.publishOdometry(state); }
+  void publishTransform(const OdometryState &state) { odometry.publishTransform(state); }
+  void publishHazardState(const HazardTransition &transition);
+
   void rosNamed(const std::vector<std::string> &msgs) {
     if (msgs.size()==0) return;
     if (msgs.size()==1) { ROS_INFO_STREAM("Kobuki : " << msgs[0]); }
@@ -212,6 +369,12 @@ private:
   GyroSensorTask     gyro_diagnostics;
   DigitalInputTask dinput_diagnostics;
   AnalogInputTask  ainput_diagnostics;
+  PublishQueueTask  queue_diagnostics;
+  StreamHealthTask stream_diagnostics;
+  CommandLatencyTask latency_diagnostics;
+  CommandAgeTask age_diagnostics;
+  SchedulingTask scheduling_diagnostics;
+  ConnectionTask connection_diagnostics;
 };
 
 } // namespace kobuki
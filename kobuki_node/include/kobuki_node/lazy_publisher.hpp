@@ -0,0 +1,74 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/lazy_publisher.hpp
+ *
+ * @brief Publisher that knows whether anyone is listening.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_LAZY_PUBLISHER_HPP_
+#define KOBUKI_NODE_LAZY_PUBLISHER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <ros/ros.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Publisher caching whether it has subscribers.
+ *
+ * The flag is refreshed from the subscriber connect/disconnect callbacks, so
+ * the stream rate code can skip building messages nobody listens to without
+ * asking the publisher every cycle.
+ */
+class LazyPublisher {
+public:
+  LazyPublisher() : subscribed(false) {}
+
+  template <typename Message>
+  void advertise(ros::NodeHandle &nh, const std::string &topic, const uint32_t &queue_size, const bool &latch = false) {
+    publisher = nh.advertise<Message>(topic, queue_size,
+                                      boost::bind(&LazyPublisher::connectionChanged, this, _1),
+                                      boost::bind(&LazyPublisher::connectionChanged, this, _1),
+                                      ros::VoidConstPtr(), latch);
+  }
+
+  /**
+   * @brief Whether anyone was listening at the last (dis)connection.
+   */
+  bool hasSubscribers() const { return subscribed.load(boost::memory_order_relaxed); }
+
+  template <typename Message>
+  void publish(const boost::shared_ptr<Message> &message) const { publisher.publish(message); }
+
+private:
+  void connectionChanged(const ros::SingleSubscriberPublisher &) {
+    subscribed.store(publisher.getNumSubscribers() > 0, boost::memory_order_relaxed);
+  }
+
+  ros::Publisher publisher;
+  boost::atomic<bool> subscribed;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_LAZY_PUBLISHER_HPP_ */
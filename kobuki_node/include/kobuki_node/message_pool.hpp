@@ -0,0 +1,98 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/message_pool.hpp
+ *
+ * @brief Recycles shared pointer messages for the stream rate publishers.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_MESSAGE_POOL_HPP_
+#define KOBUKI_NODE_MESSAGE_POOL_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Fixed set of pre-built messages handed out round robin.
+ *
+ * Publishing shared pointers gives nodelet subscribers zero-copy delivery,
+ * but allocating a fresh message every cycle churns the heap. The pool keeps
+ * a handful of messages built from a prototype (so constant fields like
+ * frame ids, covariances and array sizes are set only once) and only hands out
+ * one that nobody else holds anymore, i.e. no subscriber or publisher queue
+ * still references it. If every message is still in flight, a fresh copy of
+ * the prototype replaces the next slot; this only happens under backpressure.
+ *
+ * Not thread safe, use one pool per publishing thread.
+ */
+template <typename Message>
+class MessagePool {
+public:
+  typedef boost::shared_ptr<Message> Ptr;
+
+  MessagePool() : next(0) {}
+
+  /**
+   * @brief Build the pool from a fully initialised prototype message.
+   */
+  void init(const Message &message, const unsigned int &size = 8) {
+    prototype = message;
+    messages.clear();
+    for ( unsigned int i = 0; i < size; ++i ) {
+      messages.push_back(Ptr(new Message(prototype)));
+    }
+    next = 0;
+  }
+
+  /**
+   * @brief Get a message that can be safely modified and published.
+   *
+   * Fields not set by the prototype keep the values of the last time this
+   * message was used, so callers should overwrite everything they publish.
+   */
+  Ptr acquire() {
+    const unsigned int size = messages.size();
+    if ( size == 0 ) {
+      return Ptr(new Message(prototype)); // not initialised
+    }
+    for ( unsigned int i = 0; i < size; ++i ) {
+      unsigned int index = (next + i) % size;
+      if ( messages[index].unique() ) {
+        next = (index + 1) % size;
+        return messages[index];
+      }
+    }
+    // all in flight, retire the oldest to whoever still holds it
+    messages[next].reset(new Message(prototype));
+    Ptr message = messages[next];
+    next = (next + 1) % size;
+    return message;
+  }
+
+private:
+  Message prototype;
+  std::vector<Ptr> messages;
+  unsigned int next;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_MESSAGE_POOL_HPP_ */
@@ -18,10 +18,12 @@
 *****************************************************************************/
 
 #include <string>
-#include <geometry_msgs/Twist.h>
 #include <nav_msgs/Odometry.h>
-#include <tf/transform_broadcaster.h>
-#include <ecl/geometry/legacy_pose2d.hpp>
+#include <tf/tf.h>
+#include <tf2_msgs/TFMessage.h>
+#include "lazy_publisher.hpp"
+#include "message_pool.hpp"
+#include "odometry_model.hpp"
 
 /*****************************************************************************
 ** Namespaces
@@ -35,32 +37,31 @@ namespace kobuki {
 
 /**
  * @brief  Odometry for the kobuki node.
+ *
+ * Publishes the odometry the core integrates (see odometry_model.hpp) as
+ * odom messages and transforms.
  **/
 class Odometry {
 public:
   Odometry();
   void init(ros::NodeHandle& nh, const std::string& name);
-  bool commandTimeout() const;
-  void update(const ecl::LegacyPose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates,
-              double imu_heading, double imu_angular_velocity);
-  void resetOdometry() { pose.setIdentity(); }
-  const ros::Duration& timeout() const { return cmd_vel_timeout; }
-  void resetTimeout() { last_cmd_time = ros::Time::now(); }
+  bool useImuHeading() const { return use_imu_heading; }
+  double publishRate() const { return odom_rate; }
+  bool transformSubscribed() const { return publish_tf && tf_publisher.hasSubscribers(); }
+  bool odometrySubscribed() const { return odom_publisher.hasSubscribers(); }
+  void publishTransform(const OdometryState &state);
+  void publishOdometry(const OdometryState &state);
 
 private:
-  geometry_msgs::TransformStamped odom_trans;
-  ecl::LegacyPose2D<double> pose;
   std::string odom_frame;
   std::string base_frame;
-  ros::Duration cmd_vel_timeout;
-  ros::Time last_cmd_time;
   bool publish_tf;
   bool use_imu_heading;
-  tf::TransformBroadcaster odom_broadcaster;
-  ros::Publisher odom_publisher;
-
-  void publishTransform(const geometry_msgs::Quaternion &odom_quat);
-  void publishOdometry(const geometry_msgs::Quaternion &odom_quat, const ecl::linear_algebra::Vector3d &pose_update_rates);
+  double odom_rate;
+  LazyPublisher tf_publisher;
+  LazyPublisher odom_publisher;
+  MessagePool<tf2_msgs::TFMessage> tf_pool;
+  MessagePool<nav_msgs::Odometry> odom_pool;
 };
 
 } // namespace kobuki
@@ -0,0 +1,91 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/odometry_model.hpp
+ *
+ * @brief Integrates the wheel odometry into a pose.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_ODOMETRY_MODEL_HPP_
+#define KOBUKI_NODE_ODOMETRY_MODEL_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <ecl/geometry/legacy_pose2d.hpp>
+#include <ecl/linear_algebra.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Pose and velocities of the base in the odometry frame.
+ */
+struct OdometryState {
+  OdometryState() :
+    stamp(0.0), x(0.0), y(0.0), heading(0.0),
+    linear_velocity(0.0), lateral_velocity(0.0), angular_velocity(0.0) {}
+
+  double stamp; // [s]
+  double x, y;  // [m]
+  double heading; // [rad]
+  double linear_velocity, lateral_velocity; // [m/s]
+  double angular_velocity; // [rad/s]
+};
+
+/**
+ * @brief Accumulates the driver's per packet pose updates.
+ *
+ * With the imu heading in use, the heading (and angular velocity) come from
+ * the gyro instead of the encoders. A new driver's gyro heading starts from
+ * scratch, so after reconnected() the offset to it is taken again from the
+ * current heading.
+ */
+class OdometryModel {
+public:
+  OdometryModel() : use_imu_heading(true), heading_offset(0.0), heading_resync(false) { pose.setIdentity(); }
+
+  void useImuHeading(const bool &use) { use_imu_heading = use; }
+
+  /**
+   * @brief Integrate the pose update of a packet.
+   *
+   * @param stamp : of the packet [s].
+   * @param pose_update : pose change since the last packet.
+   * @param pose_update_rates : encoder velocities (x, y, heading).
+   * @param imu_heading : gyro heading [rad].
+   * @param imu_angular_velocity : gyro rate [rad/s].
+   * @return OdometryState : the updated state.
+   */
+  const OdometryState& update(const double &stamp, const ecl::LegacyPose2D<double> &pose_update,
+                              const ecl::linear_algebra::Vector3d &pose_update_rates,
+                              const double &imu_heading, const double &imu_angular_velocity);
+
+  void reset() { pose.setIdentity(); heading_offset = 0.0; heading_resync = false; }
+  void reconnected() { heading_resync = true; }
+
+  const OdometryState& state() const { return current; }
+
+private:
+  ecl::LegacyPose2D<double> pose;
+  bool use_imu_heading;
+  double heading_offset; // pose heading - gyro heading, changes on reconnection
+  bool heading_resync;
+  OdometryState current;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_ODOMETRY_MODEL_HPP_ */
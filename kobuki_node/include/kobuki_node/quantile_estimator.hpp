@@ -0,0 +1,65 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/quantile_estimator.hpp
+ *
+ * @brief Streaming quantile estimation in constant time and memory.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_QUANTILE_ESTIMATOR_HPP_
+#define KOBUKI_NODE_QUANTILE_ESTIMATOR_HPP_
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief P-square estimator of a single quantile.
+ *
+ * Jain & Chlamtac's algorithm: five markers track the minimum, the maximum,
+ * the quantile and two points halfway to it, and are moved along a piecewise
+ * parabolic fit as samples come in. No samples are stored, so adding one is
+ * O(1) and never allocates.
+ *
+ * Until five samples have been seen the nearest rank of the stored ones is
+ * returned instead.
+ */
+class QuantileEstimator {
+public:
+  /**
+   * @param quantile : the quantile to track, in (0, 1).
+   */
+  QuantileEstimator(const double &quantile = 0.5);
+
+  void reset() { samples = 0; }
+  void add(const double &x);
+  double value() const;
+
+  unsigned long count() const { return samples; }
+  double quantile() const { return p; }
+
+private:
+  double parabolic(const int &i, const double &d) const;
+  double linear(const int &i, const int &d) const;
+
+  double p;
+  unsigned long samples;
+  double heights[5];   // marker heights
+  long positions[5];   // actual marker positions
+  double desired[5];   // desired marker positions
+  double increments[5];
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_QUANTILE_ESTIMATOR_HPP_ */
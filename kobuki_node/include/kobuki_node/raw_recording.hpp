@@ -0,0 +1,242 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/raw_recording.hpp
+ *
+ * @brief Memory mapped ring recording of the raw serial traffic.
+ *
+ * Standalone (no ros, no driver) so recordings can be inspected and replayed
+ * by linking only kobuki_raw_recording.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_RAW_RECORDING_HPP_
+#define KOBUKI_NODE_RAW_RECORDING_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Layout of a recording.
+ *
+ * A recording is a directory of equally sized segment files used as a ring,
+ * the oldest segment is overwritten once they are all full. Values are in
+ * host byte order.
+ *
+ * @code
+ * segment : header (64 bytes), then records up to 'used' bytes
+ * header  : magic[8], version (u32), header size (u32), sequence (u64),
+ *           segment size (u64), used (u64), padding
+ * record  : length (u16), type (u8), flags (u8), firmware time stamp (u16),
+ *           reserved (u16), host time [ns since epoch] (i64),
+ *           length bytes of the packet, padded to a multiple of 8 bytes
+ * @endcode
+ *
+ * The sequence increases with every segment started, so segments are read
+ * back in sequence order. Packets are recorded as they were on the wire,
+ * i.e. with the 0xAA 0x55 header, length and checksum.
+ */
+namespace RawRecordingFormat {
+enum RecordType {
+  Stream  = 1, // packet received from the kobuki
+  Command = 2  // packet sent to the kobuki
+};
+const char magic[8] = { 'K', 'O', 'B', 'U', 'K', 'I', 'R', 'R' };
+const uint32_t version = 1;
+const size_t header_size = 64;
+const size_t record_header_size = 16;
+const size_t alignment = 8;
+
+struct SegmentHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint64_t sequence;
+  uint64_t size;
+  uint64_t used;
+  uint8_t padding[24];
+};
+
+struct RecordHeader {
+  uint16_t length;
+  uint8_t type;
+  uint8_t flags;
+  uint16_t firmware_stamp;
+  uint16_t reserved;
+  int64_t host_time;
+};
+
+std::string segmentFileName(const std::string &directory, const unsigned int &index);
+} // namespace RawRecordingFormat
+
+/**
+ * @brief Firmware time stamp of a raw stream packet.
+ *
+ * Walks the sub-payloads of a framed packet to the core sensors (which carry
+ * the stamp), works with anything indexable like the driver's buffers.
+ *
+ * @return bool : false if the packet has no core sensors sub-payload.
+ */
+template <typename Buffer>
+bool rawPacketTimeStamp(Buffer &packet, uint16_t &stamp) {
+  const unsigned int core_sensors_id = 1;
+  const unsigned int end = packet.size();
+  unsigned int i = 3; // skip header and length
+  while ( i + 4 < end ) { // sub-payload header, stamp and the checksum
+    const unsigned int id = packet[i];
+    const unsigned int length = packet[i + 1];
+    if ( id == core_sensors_id ) {
+      stamp = static_cast<uint16_t>(packet[i + 2]) | (static_cast<uint16_t>(packet[i + 3]) << 8);
+      return true;
+    }
+    i += 2 + length;
+  }
+  return false;
+}
+
+/**
+ * @brief Appends packets to a memory mapped ring of segment files.
+ *
+ * Recording a packet is a copy into the mapped segment, the kernel writes
+ * the pages back in its own time; the only system calls are made when
+ * rotating to the next segment. Since the mapping is shared, everything
+ * recorded survives a crash of the process.
+ *
+ * Not thread safe, callers recording from several threads must serialise.
+ */
+class RawRecorder {
+public:
+  RawRecorder();
+  ~RawRecorder();
+
+  /**
+   * @brief Open (or create) a recording.
+   *
+   * An existing recording in the directory is continued after its newest
+   * segment.
+   *
+   * @param directory : created if it doesn't exist.
+   * @param segment_size : size of each segment file [bytes].
+   * @param segments : number of segment files in the ring.
+   * @return bool : false if it failed, see error().
+   */
+  bool open(const std::string &directory, const size_t &segment_size, const unsigned int &segments);
+  void close();
+  bool isOpen() const { return segment != NULL; }
+
+  /**
+   * @brief Record a packet.
+   *
+   * @param type : one of RawRecordingFormat::RecordType.
+   * @param host_time : host time [ns since epoch].
+   * @param firmware_stamp : firmware time stamp [ms].
+   * @param packet : anything indexable holding the packet bytes.
+   */
+  template <typename Buffer>
+  void record(const RawRecordingFormat::RecordType &type, const int64_t &host_time,
+              const uint16_t &firmware_stamp, Buffer &packet) {
+    const size_t length = packet.size();
+    unsigned char *data = reserve(type, host_time, firmware_stamp, length);
+    if ( data == NULL ) {
+      return;
+    }
+    for ( size_t i = 0; i < length; ++i ) {
+      data[i] = packet[i];
+    }
+    commit();
+  }
+
+  const std::string& error() const { return error_message; }
+  unsigned long records() const { return record_count; }
+  unsigned long rotations() const { return rotation_count; }
+  unsigned long dropped() const { return dropped_count; }
+
+private:
+  unsigned char* reserve(const RawRecordingFormat::RecordType &type, const int64_t &host_time,
+                         const uint16_t &firmware_stamp, const size_t &length);
+  void commit();
+  bool startSegment(const unsigned int &index);
+  void unmapSegment();
+
+  std::string directory;
+  size_t segment_size;
+  unsigned int segments;
+  unsigned int index;     // of the segment being written
+  uint64_t sequence;      // of the segment being written
+  unsigned char *segment; // mapping of the segment being written
+  size_t pending;         // bytes of the record being written
+  unsigned long record_count, rotation_count, dropped_count;
+  std::string error_message;
+};
+
+/**
+ * @brief A record read back from a recording.
+ *
+ * The data points into the mapped segment, valid until the reader moves on
+ * to the next segment.
+ */
+struct RawRecord {
+  RawRecordingFormat::RecordType type;
+  uint16_t firmware_stamp;
+  int64_t host_time; // [ns since epoch]
+  const unsigned char *data;
+  size_t size;
+};
+
+/**
+ * @brief Reads the records of a recording back, oldest first.
+ */
+class RawRecordingReader {
+public:
+  RawRecordingReader();
+  ~RawRecordingReader();
+
+  bool open(const std::string &directory);
+  void close();
+
+  /**
+   * @brief The next record.
+   *
+   * @return bool : false at the end of the recording.
+   */
+  bool next(RawRecord &record);
+
+  /** @brief Go back to the oldest record. **/
+  void rewind();
+
+  const std::string& error() const { return error_message; }
+
+private:
+  bool mapSegment(const unsigned int &position);
+  void unmapSegment();
+
+  std::vector<std::string> files; // in sequence order
+  unsigned int position;          // in files of the mapped segment
+  unsigned char *segment;
+  size_t segment_size;
+  size_t offset, used;
+  std::string error_message;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_RAW_RECORDING_HPP_ */
@@ -0,0 +1,133 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/raw_replay.hpp
+ *
+ * @brief Replays a raw recording on a pseudo terminal.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_RAW_REPLAY_HPP_
+#define KOBUKI_NODE_RAW_REPLAY_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include <string>
+#include <boost/atomic.hpp>
+#include "raw_recording.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Plays the stream packets of a recording back as a serial device.
+ *
+ * Opens a pseudo terminal and writes the recorded packets to it, so a driver
+ * pointed at devicePort() parses them like the real thing. Playback starts
+ * with the first command the driver sends (i.e. once it opened the port) and
+ * follows the recorded timing, scaled by the speed, or goes as fast as the
+ * reader keeps up for a speed of 0. Commands the driver sends are read and
+ * dropped.
+ */
+class RawReplay {
+public:
+  RawReplay();
+  ~RawReplay();
+
+  /**
+   * @brief Open the recording and the pseudo terminal.
+   *
+   * @param directory : of the recording.
+   * @param speed : 1.0 for real time, N for N times faster, 0 for as fast as possible.
+   * @param loop : start over at the end of the recording.
+   * @return bool : false if it failed, see error().
+   */
+  bool open(const std::string &directory, const double &speed, const bool &loop);
+
+  /**
+   * @brief Play back until the end (unless looping) or stop().
+   *
+   * Blocks, run it in its own thread.
+   */
+  void run();
+  void stop() { stop_requested.store(true, boost::memory_order_release); }
+
+  const std::string& devicePort() const { return device_port; }
+  int64_t startTime() const { return start_time; } /**< @brief Host time of the first stream packet [ns]. */
+  uint16_t startStamp() const { return start_stamp; } /**< @brief Firmware stamp of the first stream packet [ms]. */
+  bool finished() const { return is_finished.load(boost::memory_order_acquire); }
+  unsigned long packets() const { return packet_count.load(boost::memory_order_relaxed); }
+  unsigned int loops() const { return loop_count.load(boost::memory_order_relaxed); }
+  const std::string& error() const { return error_message; }
+
+private:
+  void close();
+  bool writePacket(const unsigned char *data, const size_t &size);
+  void drainCommands();
+  bool waitForDriver();
+  bool stopping() const { return stop_requested.load(boost::memory_order_acquire); }
+
+  RawRecordingReader reader;
+  double speed;
+  bool loop;
+  int master, slave;
+  std::string device_port;
+  int64_t start_time;
+  uint16_t start_stamp;
+  // read by other threads while run() goes on
+  boost::atomic<bool> stop_requested;
+  boost::atomic<bool> is_finished;
+  boost::atomic<unsigned long> packet_count;
+  boost::atomic<unsigned int> loop_count;
+  std::string error_message;
+};
+
+/**
+ * @brief Deterministic stamps for replayed packets.
+ *
+ * Stamps are the recorded host time of the first packet plus the firmware
+ * time since then, so they only depend on the recording, not on when or how
+ * fast it is replayed. Jumps of the firmware clock over a second (the
+ * recording looped, the firmware rebooted) count as one nominal 20ms period.
+ *
+ * All times are in seconds.
+ */
+class ReplayClock {
+public:
+  ReplayClock() : epoch(0.0), last_stamp(0), unwrapped(0) {}
+
+  void start(const double &start_time, const uint16_t &start_stamp) {
+    epoch = start_time;
+    last_stamp = start_stamp;
+    unwrapped = 0;
+  }
+
+  double update(const uint16_t &firmware_stamp) {
+    const uint16_t delta = static_cast<uint16_t>(firmware_stamp - last_stamp);
+    unwrapped += (delta < 1000) ? delta : 20;
+    last_stamp = firmware_stamp;
+    return epoch + static_cast<double>(unwrapped) * 0.001;
+  }
+
+private:
+  double epoch;
+  uint16_t last_stamp;
+  uint64_t unwrapped; // [ms]
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_RAW_REPLAY_HPP_ */
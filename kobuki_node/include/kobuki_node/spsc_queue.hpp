@@ -0,0 +1,116 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/spsc_queue.hpp
+ *
+ * @brief Lock-free single producer, single consumer queue.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_SPSC_QUEUE_HPP_
+#define KOBUKI_NODE_SPSC_QUEUE_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <cstddef>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Lock-free single producer, single consumer queue.
+ *
+ * Hands items over from one thread to another. The slots are allocated up
+ * front and copied into, so pushing doesn't allocate. When the consumer falls
+ * behind, new items are dropped and counted.
+ */
+template <typename Item>
+class SpscQueue {
+public:
+  SpscQueue() : slots(0), head(0), tail(0), dropped(0) {}
+
+  /**
+   * @brief Allocate the slots, call before the producer and consumer start.
+   */
+  void init(const unsigned int &capacity) {
+    slots = capacity + 1; // one slot always stays empty to tell full from empty
+    items.reset(new Item[slots]);
+    head = 0;
+    tail = 0;
+    dropped = 0;
+  }
+
+  /**
+   * @brief Producer side, copy in an item.
+   *
+   * @return bool : false if the queue was full and the item got dropped.
+   */
+  bool push(const Item &item) {
+    const unsigned int current_tail = tail.load(boost::memory_order_relaxed);
+    const unsigned int next_tail = (current_tail + 1) % slots;
+    if ( next_tail == head.load(boost::memory_order_acquire) ) {
+      dropped.fetch_add(1, boost::memory_order_relaxed);
+      return false;
+    }
+    items[current_tail] = item;
+    tail.store(next_tail, boost::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Consumer side, oldest item in the queue.
+   *
+   * @return Item* : pointer to the item, or NULL if empty.
+   */
+  const Item* front() const {
+    const unsigned int current_head = head.load(boost::memory_order_relaxed);
+    if ( current_head == tail.load(boost::memory_order_acquire) ) {
+      return NULL;
+    }
+    return &items[current_head];
+  }
+
+  /**
+   * @brief Consumer side, release the item returned by front().
+   */
+  void pop() {
+    const unsigned int current_head = head.load(boost::memory_order_relaxed);
+    head.store((current_head + 1) % slots, boost::memory_order_release);
+  }
+
+  bool empty() const { return front() == NULL; }
+  // both 0 before init(), e.g. when publishing synchronously
+  unsigned int capacity() const { return (slots > 0) ? slots - 1 : 0; }
+  unsigned int size() const {
+    if ( slots == 0 ) {
+      return 0;
+    }
+    return (tail.load(boost::memory_order_acquire) + slots - head.load(boost::memory_order_acquire)) % slots;
+  }
+  unsigned long droppedCount() const { return dropped.load(boost::memory_order_relaxed); }
+
+private:
+  boost::scoped_array<Item> items;
+  unsigned int slots;
+  boost::atomic<unsigned int> head; // next slot to read, owned by the consumer
+  boost::atomic<unsigned int> tail; // next slot to write, owned by the producer
+  boost::atomic<unsigned long> dropped;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_SPSC_QUEUE_HPP_ */
@@ -0,0 +1,79 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/startup_monitor.hpp
+ *
+ * @brief Signals when a freshly started driver is ready.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_STARTUP_MONITOR_HPP_
+#define KOBUKI_NODE_STARTUP_MONITOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <boost/atomic.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Readiness of a driver, i.e. streaming and version info received.
+ *
+ * The driver thread signals the first stream and version info packets,
+ * startup blocks on them instead of sleeping for a guessed duration. Also
+ * keeps how long each took since the driver was started.
+ *
+ * All times are in seconds.
+ */
+class StartupMonitor {
+public:
+  StartupMonitor();
+
+  void start(const double &now); /**< @brief A new driver was started, forget the old one. **/
+  void streamReceived(const double &now);
+  void versionReceived(const double &now);
+
+  /**
+   * @brief Block until both the stream and the version info came in.
+   *
+   * @param timeout : maximum time to wait.
+   * @return bool : false if timed out.
+   */
+  bool waitUntilReady(const double &timeout);
+
+  /** @brief Cheap enough to check on every packet. **/
+  bool streamReady() const { return stream_ready.load(boost::memory_order_acquire); }
+  bool versionReady() const;
+  double timeToStream() const;  /**< @brief Time to the first stream packet, negative if none yet. **/
+  double timeToVersion() const; /**< @brief Time to the version info, negative if none yet. **/
+
+private:
+  bool ready() const { return stream_ready.load(boost::memory_order_relaxed) && version_ready; }
+
+  mutable boost::mutex mutex;
+  boost::condition_variable condition;
+  boost::atomic<bool> stream_ready;
+  bool version_ready;
+  double started;
+  double first_stream;
+  double first_version;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_STARTUP_MONITOR_HPP_ */
@@ -0,0 +1,127 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/stream_health.hpp
+ *
+ * @brief Packet loss, jitter and clock statistics of the sensor stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_STREAM_HEALTH_HPP_
+#define KOBUKI_NODE_STREAM_HEALTH_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include <ecl/threads/mutex.hpp>
+#include "firmware_clock.hpp"
+#include "quantile_estimator.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Stream statistics over one reporting window, and the verdict on them.
+ *
+ * Jitter is the deviation of the host receive intervals from the firmware's
+ * own spacing of the packets, delay the receive delay w.r.t. the firmware
+ * clock model. All in milliseconds unless noted.
+ */
+struct StreamHealthReport {
+  enum Status {
+    Healthy,
+    NoPackets,
+    Lossy,     // loss over the threshold
+    Jittery    // 99th percentile jitter over the threshold
+  };
+
+  StreamHealthReport();
+
+  Status status;
+  double rate;  // [Hz]
+  unsigned long packets;
+  unsigned long lost;
+  double loss;  // [%]
+  double jitter_median, jitter_p95, jitter_p99, jitter_max;
+  double delay_median, delay_p99;
+  double clock_offset; // [s]
+  double clock_skew;   // [s/s]
+  unsigned int clock_resyncs;
+  unsigned long total_packets;
+  unsigned long total_lost;
+};
+
+/**
+ * @brief Accumulates the stream statistics between reports.
+ *
+ * Updated from the driver thread for every packet, reported from any other;
+ * both are guarded.
+ */
+class StreamHealth {
+public:
+  /**
+   * @param loss_threshold : report lossy above this percentage of lost packets.
+   * @param jitter_threshold : report jittery above this 99th percentile jitter [ms].
+   */
+  StreamHealth(const double &loss_threshold = 1.0, const double &jitter_threshold = 10.0);
+
+  /**
+   * @brief Register a stream packet.
+   *
+   * @param firmware_stamp : firmware time stamp of the packet [ms].
+   * @param receive_time : host time at which it was received [s].
+   * @param clock : firmware clock model, already updated with this packet.
+   */
+  void update(const uint16_t &firmware_stamp, const double &receive_time, const FirmwareClock &clock);
+
+  /**
+   * @brief Don't count the gap to the next packet, e.g. after reconnecting.
+   */
+  void restart() { mutex.lock(); started = false; mutex.unlock(); }
+
+  /**
+   * @brief Evaluate the current window and start a new one.
+   */
+  void report(StreamHealthReport &report);
+
+private:
+  ecl::Mutex mutex;
+  const double loss_threshold;
+  const double jitter_threshold;
+
+  bool started;
+  uint16_t last_stamp;
+  double last_receive_time;
+
+  // current window
+  unsigned long packets;
+  unsigned long lost;
+  unsigned long intervals;
+  double interval_time;
+  QuantileEstimator jitter_median, jitter_p95, jitter_p99;
+  QuantileEstimator delay_median, delay_p99;
+  double jitter_max;
+
+  // totals
+  unsigned long total_packets;
+  unsigned long total_lost;
+
+  double clock_offset, clock_skew;
+  unsigned int clock_resyncs;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_STREAM_HEALTH_HPP_ */
@@ -0,0 +1,123 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/stream_sink.hpp
+ *
+ * @brief Where the core delivers what it makes of the sensor stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_STREAM_SINK_HPP_
+#define KOBUKI_NODE_STREAM_SINK_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "decimation.hpp"
+#include "odometry_model.hpp"
+#include "stream_snapshot.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Outputs
+*****************************************************************************/
+
+namespace StreamOutput {
+enum Type {
+  SensorState,
+  CompactSensorState,
+  JointState,
+  Inertia,
+  RawInertia,
+  DockIR,
+  Odometry,
+  Transform
+};
+} // namespace StreamOutput
+
+/**
+ * @brief Bits of the hazard bitmask, the same as in kobuki_node/HazardState.
+ */
+namespace Hazards {
+enum Flags {
+  BumperLeft = 1,
+  BumperCenter = 2,
+  BumperRight = 4,
+  CliffLeft = 8,
+  CliffCenter = 16,
+  CliffRight = 32,
+  WheelDropLeft = 64,
+  WheelDropRight = 128
+};
+} // namespace Hazards
+
+/**
+ * @brief A change of the hazard state.
+ */
+struct HazardTransition {
+  HazardTransition() : stamp(0.0), hazards(0), changed(0), sequence(0), time_stamp(0) {}
+
+  double stamp;        // [s]
+  uint8_t hazards;     // all hazards currently active
+  uint8_t changed;     // bits that changed since the previous transition
+  uint32_t sequence;   // increases by one with every transition
+  uint16_t time_stamp; // firmware time stamp of the packet [ms]
+};
+
+/**
+ * @brief The 3 axis gyro samples of a packet, in the robot's frame.
+ */
+struct RawInertiaSamples {
+  static const unsigned int capacity = 8;
+
+  RawInertiaSamples() : size(0), frame_id(0), packet_stamp(0.0) {}
+
+  unsigned int size;
+  uint8_t frame_id;                         // of the first sample, the gyro counts them from 0 to 255
+  double packet_stamp;                      // of the stream packet, the last sample's [s]
+  double stamp[capacity];                   // [s]
+  double angular_velocity[capacity][3];     // x, y, z [rad/s]
+};
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Receives the outputs of the core, e.g. to publish them.
+ *
+ * Outputs nobody is subscribed() to are skipped, without building them. The
+ * hazard transitions are delivered from the driver thread, everything else
+ * from whichever thread runs KobukiCore::process().
+ */
+class StreamSink {
+public:
+  virtual ~StreamSink() {}
+
+  virtual bool subscribed(const StreamOutput::Type &output) const = 0;
+
+  virtual void publishSensorState(const StreamSnapshot &snapshot, const SensorStateWindow &window) = 0;
+  virtual void publishCompactSensorState(const uint8_t *frame, const size_t &size) = 0;
+  virtual void publishJointState(const StreamSnapshot &snapshot) = 0;
+  virtual void publishInertia(const StreamSnapshot &snapshot, const InertiaWindow &window) = 0;
+  virtual void publishRawInertia(const RawInertiaSamples &samples) = 0;
+  virtual void publishDockIR(const StreamSnapshot &snapshot, const DockIRWindow &window) = 0;
+  virtual void publishOdometry(const OdometryState &state) = 0;
+  virtual void publishTransform(const OdometryState &state) = 0;
+  virtual void publishHazardState(const HazardTransition &transition) = 0;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_STREAM_SINK_HPP_ */
@@ -0,0 +1,125 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/stream_snapshot.hpp
+ *
+ * @brief Per-packet copy of the kobuki sensor stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_STREAM_SNAPSHOT_HPP_
+#define KOBUKI_NODE_STREAM_SNAPSHOT_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <ecl/threads/mutex.hpp>
+#include <ecl/geometry/legacy_pose2d.hpp>
+#include <ecl/linear_algebra.hpp>
+#include <kobuki_driver/kobuki.hpp>
+#include "odometry_model.hpp"
+#include "spsc_queue.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Everything the ros wrapper needs from a single stream packet.
+ *
+ * Captured once in the stream data slot, so every topic published for a
+ * cycle (and the diagnostics) describe exactly the same packet.
+ */
+struct StreamSnapshot {
+  StreamSnapshot() :
+    stamp(0.0), receive_time(0.0),
+    heading(0.0), angular_velocity(0.0),
+    wheel_left_position(0.0), wheel_left_velocity(0.0),
+    wheel_right_position(0.0), wheel_right_velocity(0.0)
+  {
+    pose_update.setIdentity();
+    pose_update_rates << 0.0, 0.0, 0.0;
+  }
+
+  double stamp;        // host time at which the firmware stamped the packet [s]
+  double receive_time; // host time at which the packet was received [s]
+
+  CoreSensors::Data core_sensors;
+  DockIR::Data dock_ir;
+  Inertia::Data inertia;
+  Cliff::Data cliff;
+  Current::Data current;
+  GpInput::Data gp_input;
+  ThreeAxisGyro::Data raw_inertia;
+  Battery battery;
+
+  ecl::LegacyPose2D<double> pose_update;
+  ecl::linear_algebra::Vector3d pose_update_rates;
+  double heading;
+  double angular_velocity;
+  double wheel_left_position, wheel_left_velocity;
+  double wheel_right_position, wheel_right_velocity;
+
+  OdometryState odometry; // integrated up to and including this packet
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief Double buffer handing snapshots from the driver thread to readers.
+ *
+ * The writer (the stream data slot) fills back() without locking and then
+ * commit()s it. Other threads take a copy of the committed snapshot with
+ * read(); the lock is only held for the swap and that copy.
+ */
+class StreamSnapshotBuffer {
+public:
+  StreamSnapshotBuffer() : front_index(0) {}
+
+  /**
+   * @brief Snapshot being filled by the writer, only touch from the writer thread.
+   */
+  StreamSnapshot& back() { return snapshots[1 - front_index]; }
+
+  /**
+   * @brief Last committed snapshot, only touch from the writer thread.
+   */
+  const StreamSnapshot& front() const { return snapshots[front_index]; }
+
+  void commit() {
+    mutex.lock();
+    front_index = 1 - front_index;
+    mutex.unlock();
+  }
+
+  void read(StreamSnapshot &snapshot) {
+    mutex.lock();
+    snapshot = snapshots[front_index];
+    mutex.unlock();
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+private:
+  ecl::Mutex mutex;
+  StreamSnapshot snapshots[2];
+  unsigned int front_index;
+};
+
+/**
+ * @brief Hands snapshots from the driver thread over to the publishing thread.
+ */
+typedef SpscQueue<StreamSnapshot> StreamSnapshotQueue;
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_STREAM_SNAPSHOT_HPP_ */
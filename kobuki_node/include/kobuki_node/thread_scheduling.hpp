@@ -0,0 +1,105 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/thread_scheduling.hpp
+ *
+ * @brief Real time scheduling and cpu affinity of the kobuki threads.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_THREAD_SCHEDULING_HPP_
+#define KOBUKI_NODE_THREAD_SCHEDULING_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <ecl/threads/mutex.hpp>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Applies one scheduling configuration to every thread that asks.
+ *
+ * Threads we don't create ourselves (the driver's serial thread, the ros
+ * spinner) can only be configured from within, so each thread calls
+ * apply() once when it starts running. Whatever the process isn't allowed
+ * to do (no CAP_SYS_NICE, rtprio or memlock limits) is skipped and
+ * recorded, the thread just carries on with its normal scheduling.
+ */
+class ThreadScheduling {
+public:
+  enum Policy {
+    Fifo,
+    RoundRobin
+  };
+
+  ThreadScheduling() : priority(0), policy(Fifo), lock_memory(false) {}
+
+  /**
+   * @brief Configure, call before any thread applies it.
+   *
+   * @param priority : real time priority (1-99), 0 keeps normal scheduling.
+   * @param policy : "fifo" or "rr".
+   * @param cpus : cpus the threads may run on, empty for any.
+   * @param lock_memory : lock the process memory (mlockall).
+   * @return bool : false if the policy or a cpu is invalid.
+   */
+  bool init(const int &priority, const std::string &policy, const std::vector<int> &cpus, const bool &lock_memory);
+
+  /**
+   * @brief Lock the process memory if configured, once from any thread.
+   */
+  void lockMemory();
+
+  /**
+   * @brief Apply the configuration to the calling thread.
+   *
+   * A thread that comes back (the driver's, on reconnection) applies it
+   * again under the same name and replaces its earlier outcome.
+   *
+   * @param thread_name : name to report the outcome under.
+   */
+  void apply(const std::string &thread_name);
+
+  bool configured() const { return (priority > 0) || !cpus.empty() || lock_memory; }
+  const std::string& error() const { return error_message; }
+
+  /**
+   * @brief Latest outcome for the memory lock and each thread applied so far.
+   *
+   * @return bool : false if any of them could not be applied.
+   */
+  bool report(std::vector<std::pair<std::string, std::string> > &outcomes);
+
+private:
+  void record(const std::string &name, const std::string &outcome, const bool &failed);
+
+  int priority;
+  Policy policy;
+  std::vector<int> cpus;
+  bool lock_memory;
+  std::string error_message;
+
+  ecl::Mutex mutex;
+  std::vector<std::pair<std::string, std::string> > outcomes; // one per name
+  std::vector<bool> failed_outcomes; // alongside the outcomes
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_THREAD_SCHEDULING_HPP_ */
@@ -0,0 +1,109 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/velocity_mux.hpp
+ *
+ * @brief Arbitration between prioritized velocity command inputs.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_VELOCITY_MUX_HPP_
+#define KOBUKI_NODE_VELOCITY_MUX_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <string>
+#include <vector>
+#include "clock.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief One velocity command input, as in the cmd_vel_mux configurations.
+ */
+struct VelocityMuxInput {
+  VelocityMuxInput() : timeout(0.0), priority(0) {}
+  VelocityMuxInput(const std::string &name, const std::string &topic,
+                   const double &timeout, const unsigned int &priority) :
+    name(name), topic(topic), timeout(timeout), priority(priority) {}
+
+  std::string name;
+  std::string topic;
+  double timeout;        // [s] without commands before the input goes inactive
+  unsigned int priority; // unique, higher wins
+};
+
+/**
+ * @brief Picks which velocity command input drives the base.
+ *
+ * Same rules as the cmd_vel_mux nodelet: the input that last got through
+ * keeps the base until it is quiet for longer than its timeout, only an
+ * input of higher priority can take over before that. Commands of any
+ * other input are dropped.
+ *
+ * Inputs are referred to by their index in the configuration, so the
+ * command path never touches a string. Not thread safe, guard
+ * commandReceived() and update() with the same lock.
+ */
+class VelocityMux {
+public:
+  static const int idle = -1; /**< @brief No input is active. **/
+
+  VelocityMux(const Clock &clock) : clock(clock), active_input(idle) {}
+
+  /**
+   * @brief Replace the inputs.
+   *
+   * @return bool : false if they are invalid (empty or duplicate names or
+   *                duplicate priorities), see error().
+   */
+  bool configure(const std::vector<VelocityMuxInput> &inputs);
+
+  /**
+   * @brief A command arrived on an input.
+   *
+   * @param input : index of the input.
+   * @return bool : whether it goes through to the base.
+   */
+  bool commandReceived(const unsigned int &input);
+
+  /**
+   * @brief Let the active input go idle once it times out.
+   *
+   * @return bool : true if it did.
+   */
+  bool update();
+
+  bool configured() const { return !inputs.empty(); }
+  unsigned int size() const { return static_cast<unsigned int>(inputs.size()); }
+  const VelocityMuxInput& input(const unsigned int &index) const { return inputs[index]; }
+  int active() const { return active_input; } /**< @brief Index of the active input or idle. **/
+  const std::string& activeName() const; /**< @brief Name of the active input or "idle". **/
+  const std::string& error() const { return error_message; }
+
+private:
+  bool expired(const double &now) const;
+
+  const Clock &clock;
+  std::vector<VelocityMuxInput> inputs;
+  std::vector<double> last_command; // per input, -1 before the first
+  int active_input;
+  std::string error_message;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_VELOCITY_MUX_HPP_ */
@@ -0,0 +1,109 @@
+/**
+ * @file /kobuki_node/include/kobuki_node/velocity_smoother.hpp
+ *
+ * @brief Jerk limited velocity smoothing, stepped with the stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_VELOCITY_SMOOTHER_HPP_
+#define KOBUKI_NODE_VELOCITY_SMOOTHER_HPP_
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Limits of one axis, 0 for unlimited.
+ */
+struct SmoothingLimits {
+  SmoothingLimits(const double &acceleration = 0.0, const double &jerk = 0.0) :
+    acceleration(acceleration), jerk(jerk) {}
+
+  double acceleration; // [m/s^2] or [rad/s^2]
+  double jerk;         // [m/s^3] or [rad/s^3]
+};
+
+/**
+ * @brief Ramps the base velocity towards the commanded one.
+ *
+ * Each axis accelerates as fast as its limits allow, easing the
+ * acceleration in and out at the jerk limit so it arrives at the target
+ * without overshooting. Stepped once per stream packet, right before the
+ * driver sends its base control command, so every command that goes out
+ * is one step further along the ramp.
+ *
+ * The measured velocities are fed back: when the base is not following
+ * (blocked, pushed, just enabled) the ramp restarts from where the base
+ * actually is instead of winding up.
+ *
+ * Not thread safe, guard command(), stop() and step() with the same lock.
+ */
+class VelocitySmoother {
+public:
+  VelocitySmoother() : is_enabled(false), last_stamp(-1.0) {}
+
+  void configure(const SmoothingLimits &linear_limits, const SmoothingLimits &angular_limits);
+  bool enabled() const { return is_enabled; }
+
+  /**
+   * @brief New target velocities [m/s], [rad/s].
+   */
+  void command(const double &linear_velocity, const double &angular_velocity) {
+    linear_axis.target = linear_velocity;
+    angular_axis.target = angular_velocity;
+  }
+
+  /**
+   * @brief Ramp down to a standstill.
+   */
+  void stop() { command(0.0, 0.0); }
+
+  /**
+   * @brief Start over from the measured velocities, with no target.
+   */
+  void reset(const double &measured_linear, const double &measured_angular);
+
+  /**
+   * @brief Advance the ramps to a stream packet.
+   *
+   * @param stamp : time of the packet [s].
+   * @param measured_linear : base velocity from the wheels [m/s].
+   * @param measured_angular : base velocity from the wheels [rad/s].
+   */
+  void step(const double &stamp, const double &measured_linear, const double &measured_angular);
+
+  double linear() const { return linear_axis.velocity; }   /**< @brief Velocity to command [m/s]. **/
+  double angular() const { return angular_axis.velocity; } /**< @brief Velocity to command [rad/s]. **/
+
+private:
+  struct Axis {
+    Axis() : target(0.0), velocity(0.0), acceleration(0.0), tolerance(0.0) {}
+    void reset(const double &measured);
+    void step(const double &dt, const double &measured);
+
+    SmoothingLimits limits;
+    double target;
+    double velocity;
+    double acceleration;
+    double tolerance; // measured velocity this far off restarts the ramp
+  };
+
+  bool is_enabled;
+  double last_stamp;
+  Axis linear_axis, angular_axis;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_VELOCITY_SMOOTHER_HPP_ */
@@ -0,0 +1,212 @@
+/**
+ * @file /kobuki_node/src/bench/allocation_check.cpp
+ *
+ * @brief Checks the stream and velocity command paths don't allocate.
+ *
+ * Drives the core with synthetic packets at 50Hz and velocity commands from
+ * two mux inputs, the way the node's stream slot, publishing thread and
+ * velocity command callbacks drive it, and traps the first heap allocation
+ * after the warm up. Exits non zero with the call stack of the allocation
+ * if one turns up, so it can gate changes to the hot path.
+ *
+ * Only the core is driven, its outputs go to a MockSink: the KobukiRos sink
+ * callbacks that build and publish the ros messages (message pools, ros
+ * publishers) are not covered.
+ *
+ * The stream slot's copy of the driver data, KobukiCore::capture(), runs
+ * against an idle driver. The driver's getters return the sensor data by
+ * value, so their std::vector copies allocate on every packet, short of
+ * changing the driver; capture() is allowed exactly those and nothing more.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <unistd.h>
+#include "../../include/kobuki_node/command_latency.hpp"
+#include "../../include/kobuki_node/kobuki_core.hpp"
+#include "../../include/kobuki_node/velocity_mux.hpp"
+#include "../../include/kobuki_node/velocity_smoother.hpp"
+#include "allocation_counter.hpp"
+#include "synthetic_stream.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+using namespace kobuki;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+
+const unsigned int warm_up_packets = 1000;     // fill the windows, pools and caches first
+const unsigned int steady_state_packets = 15000; // five minutes of stream
+// getDockIRData(), getCliffData(), getCurrentData() and getGpInputData() copy a vector each
+const unsigned long driver_copies = 4;
+
+/**
+ * @brief One base, with what the node keeps around the core.
+ */
+struct Base {
+  Base(const CoreParameters &parameters, const bool &subscribed) :
+    core(clock), capture_core(clock), velocity_mux(clock), sink(subscribed), linear(0.0)
+  {
+    core.init(parameters);
+    capture_core.init(parameters);
+    command_age.configure(0.2);
+    std::vector<VelocityMuxInput> inputs;
+    inputs.push_back(VelocityMuxInput("Navigation", "navigation", 0.5, 1));
+    inputs.push_back(VelocityMuxInput("Teleop", "teleop", 0.1, 2));
+    velocity_mux.configure(inputs);
+    velocity_smoother.configure(SmoothingLimits(0.5, 2.0), SmoothingLimits(2.0, 10.0));
+  }
+
+  /**
+   * @brief Velocity command callback, less the driver and ros.
+   */
+  void velocityCommand(const unsigned int &input, const double &linear_velocity, const double &angular_velocity) {
+    if ( !command_age.accept(0.005) ) {
+      return;
+    }
+    if ( velocity_mux.commandReceived(input) ) {
+      velocity_smoother.command(linear_velocity, angular_velocity);
+      core.commandTimeout().commandReceived();
+      command_latency.commandApplied(clock.now(), clock.now(), linear_velocity, angular_velocity);
+    }
+  }
+
+  /**
+   * @brief Stream slot and publishing thread for a packet.
+   */
+  void cycle() {
+    stream.next(snapshot);
+    clock.set(snapshot.receive_time);
+    core.stamp(snapshot);
+    core.integrate(snapshot);
+    command_latency.motionMeasured(clock.now(), snapshot.pose_update_rates[0], snapshot.pose_update_rates[2]);
+    if ( core.commandTimeout().check(true) ) {
+      velocity_smoother.stop();
+    }
+    velocity_mux.update();
+    velocity_smoother.step(snapshot.stamp, snapshot.pose_update_rates[0], snapshot.pose_update_rates[2]);
+    core.processHazards(snapshot, sink);
+    core.process(snapshot, sink);
+    command_latency.commandSent(clock.now());
+  }
+
+  /**
+   * @brief Stream slot's copy of the driver data.
+   *
+   * An idle driver has no packets worth processing, so it gets its own core
+   * and the synthetic packets go through the rest.
+   */
+  void capture() {
+    capture_core.capture(kobuki, captured);
+  }
+
+  /**
+   * @brief Commands, alternating steps and repeats, then their packet.
+   *
+   * Teleop takes over for a second out of every ten, so the mux switches.
+   */
+  void step(const unsigned int &packet) {
+    if ( packet % 25 == 0 ) {
+      linear = (linear > 0.0) ? 0.0 : 0.2;
+    }
+    velocityCommand(0, linear, 0.5 * linear);
+    if ( packet % 500 < 50 ) {
+      velocityCommand(1, 0.1, 0.0);
+    }
+    cycle();
+  }
+
+  ManualClock clock;
+  KobukiCore core;
+  Kobuki kobuki;
+  KobukiCore capture_core;
+  StreamSnapshot captured;
+  VelocityMux velocity_mux;
+  VelocitySmoother velocity_smoother;
+  CommandLatencyTracer command_latency;
+  CommandAgeFilter command_age;
+  SyntheticStream stream;
+  MockSink sink;
+  StreamSnapshot snapshot;
+  double linear;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+CoreParameters decimatedParameters() {
+  CoreParameters parameters;
+  parameters.sensor_state_rate = 10.0;
+  parameters.joint_state_rate = 10.0;
+  parameters.dock_ir_rate = 10.0;
+  parameters.inertia_rate = 10.0;
+  parameters.odometry_rate = 10.0;
+  return parameters;
+}
+
+/**
+ * @return bool : no allocations once warmed up, beyond the driver's copies.
+ */
+bool check(const char *name, const CoreParameters &parameters, const bool &subscribed) {
+  Base *base = new Base(parameters, subscribed);
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    base->capture();
+    base->step(i);
+  }
+  const char *culprit = NULL;
+  unsigned int packet = 0;
+  while ( (packet < steady_state_packets) && (culprit == NULL) ) {
+    AllocationCounter::arm(driver_copies);
+    base->capture();
+    AllocationCounter::disarm();
+    if ( AllocationCounter::tripped() ) {
+      culprit = "capture";
+      break;
+    }
+    AllocationCounter::arm();
+    base->step(warm_up_packets + packet);
+    AllocationCounter::disarm();
+    ++packet;
+    if ( AllocationCounter::tripped() ) {
+      culprit = "stream and command cycle";
+    }
+  }
+  delete base;
+  if ( culprit == NULL ) {
+    printf("kobuki_node_allocation_check : %s, no allocations in %u packets (besides the driver's %lu copies).\n",
+           name, steady_state_packets, driver_copies);
+    return true;
+  }
+  fprintf(stderr, "kobuki_node_allocation_check : %s, %s allocated after %u steady state packets, at\n",
+          name, culprit, packet);
+  AllocationCounter::report(STDERR_FILENO);
+  return false;
+}
+
+} // namespace
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int /*argc*/, char ** /*argv*/) {
+  if ( !AllocationCounter::available() ) {
+    fprintf(stderr, "kobuki_node_allocation_check : allocations are only counted with glibc, skipping\n");
+    return 0;
+  }
+  bool passed = true;
+  passed = check("all subscribed", CoreParameters(), true) && passed;
+  passed = check("decimated", decimatedParameters(), true) && passed;
+  passed = check("unsubscribed", CoreParameters(), false) && passed;
+  return passed ? 0 : 1;
+}
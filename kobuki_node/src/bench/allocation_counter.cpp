@@ -0,0 +1,143 @@
+/**
+ * @file /kobuki_node/src/bench/allocation_counter.cpp
+ *
+ * @brief Counts the heap allocations of the calling thread.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <errno.h>
+#include <stddef.h>
+#ifdef __GLIBC__
+  #include <execinfo.h>
+#endif
+#include "allocation_counter.hpp"
+
+/*****************************************************************************
+** Interposition
+*****************************************************************************/
+
+#ifdef __GLIBC__
+
+namespace {
+
+const int max_call_depth = 32;
+
+// initial exec tls, safe to touch from within malloc
+__thread unsigned long allocations = 0;
+__thread bool armed = false;
+__thread unsigned long allowance = 0;
+__thread bool trapped = false;
+__thread void* call_site[max_call_depth];
+__thread int call_depth = 0;
+
+inline void allocated() {
+  ++allocations;
+  if ( armed && (allowance > 0) ) {
+    --allowance;
+  } else if ( armed ) {
+    armed = false; // before backtrace(), it may allocate itself
+    trapped = true;
+    call_depth = backtrace(call_site, max_call_depth);
+  }
+}
+
+} // namespace
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+// operator new ends up in here too
+void* malloc(size_t size) {
+  allocated();
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  allocated();
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void *pointer, size_t size) {
+  allocated();
+  return __libc_realloc(pointer, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+  allocated();
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  allocated();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+  allocated();
+  void *result = __libc_memalign(alignment, size);
+  if ( result == NULL ) {
+    return ENOMEM;
+  }
+  *pointer = result;
+  return 0;
+}
+
+} // extern "C"
+
+#endif
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+namespace AllocationCounter {
+
+#ifdef __GLIBC__
+bool available() { return true; }
+unsigned long count() { return allocations; }
+
+void arm(const unsigned long &allowed) {
+  // the first backtrace() loads libgcc, get that over with while disarmed
+  void *warm_up[1];
+  backtrace(warm_up, 1);
+  trapped = false;
+  call_depth = 0;
+  allowance = allowed;
+  armed = true;
+}
+
+void disarm() { armed = false; }
+bool tripped() { return trapped; }
+
+void report(const int &file_descriptor) {
+  if ( trapped ) {
+    backtrace_symbols_fd(call_site, call_depth, file_descriptor); // doesn't allocate
+  }
+}
+#else
+bool available() { return false; }
+unsigned long count() { return 0; }
+void arm(const unsigned long &/*allowed*/) {}
+void disarm() {}
+bool tripped() { return false; }
+void report(const int &/*file_descriptor*/) {}
+#endif
+
+} // namespace AllocationCounter
+
+} // namespace kobuki
@@ -0,0 +1,70 @@
+/**
+ * @file /kobuki_node/src/bench/allocation_counter.hpp
+ *
+ * @brief Counts the heap allocations of the calling thread.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_ALLOCATION_COUNTER_HPP_
+#define KOBUKI_NODE_ALLOCATION_COUNTER_HPP_
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Per thread heap allocation counter.
+ *
+ * Linking allocation_counter.cpp into an executable interposes the malloc
+ * family (and with it operator new), so every allocation of the calling
+ * thread is counted. Only works on glibc, elsewhere available() is false
+ * and the count stays 0.
+ */
+namespace AllocationCounter {
+
+bool available();
+
+/**
+ * @return unsigned long : allocations of the calling thread so far.
+ */
+unsigned long count();
+
+/**
+ * @brief Trap the next allocation of the calling thread.
+ *
+ * The first allocation after arming, beyond the allowed ones, records its
+ * call stack and disarms again, report() prints it.
+ *
+ * @param allowed : allocations to let through first.
+ */
+void arm(const unsigned long &allowed = 0);
+void disarm();
+
+/**
+ * @return bool : an allocation was trapped since the last arm().
+ */
+bool tripped();
+
+/**
+ * @brief Print the call stack of the trapped allocation.
+ *
+ * Symbol names need the executable linked with -rdynamic.
+ */
+void report(const int &file_descriptor);
+
+} // namespace AllocationCounter
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_ALLOCATION_COUNTER_HPP_ */
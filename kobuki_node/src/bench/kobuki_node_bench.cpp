@@ -0,0 +1,320 @@
+/**
+ * @file /kobuki_node/src/bench/kobuki_node_bench.cpp
+ *
+ * @brief Microbenchmarks of the stream processing hot path.
+ *
+ * Drives the core (what the node's stream slot and publishing thread run
+ * for every packet) with synthetic packets against mock publishers and
+ * reports, besides the usual timings:
+ *
+ * - ns_per_packet : wall time per stream packet
+ * - allocs_per_packet : heap allocations per packet, once warmed up
+ * - cache_misses_per_packet : where the kernel gives us hardware counters
+ *
+ * Results also go to kobuki_node_bench.json (google benchmark's json
+ * format) unless --benchmark_out is given, to compare across releases.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "../../include/kobuki_node/kobuki_core.hpp"
+#include "allocation_counter.hpp"
+#include "perf_counter.hpp"
+#include "synthetic_stream.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+using namespace kobuki;
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+
+const unsigned int warm_up_packets = 1000; // fill the windows, pools and caches first
+const unsigned int max_bases = 32;
+
+double monotonicTime() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1.0e-9;
+}
+
+/**
+ * @brief One simulated base: its core, stream and publishers.
+ */
+struct Base {
+  Base(const CoreParameters &parameters, const uint32_t &seed, const bool &subscribed) :
+    core(clock), stream(seed), sink(subscribed)
+  {
+    core.init(parameters);
+  }
+
+  /**
+   * @brief What the driver and the publishing thread do for a packet.
+   */
+  void cycle() {
+    stream.next(snapshot);
+    core.stamp(snapshot);
+    core.integrate(snapshot);
+    core.processHazards(snapshot, sink);
+    core.process(snapshot, sink);
+  }
+
+  ManualClock clock;
+  KobukiCore core;
+  SyntheticStream stream;
+  MockSink sink;
+  StreamSnapshot snapshot;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+/**
+ * @brief Measures the per packet counters over a benchmark's timed loop.
+ */
+class PacketCounters {
+public:
+  PacketCounters() : start_time(monotonicTime()), start_allocations(AllocationCounter::count()),
+    start_misses(cache_misses.read()) {}
+
+  void report(benchmark::State &state, const double &packets) {
+    const double elapsed = monotonicTime() - start_time;
+    const unsigned long allocations = AllocationCounter::count() - start_allocations;
+    // per thread figures, averaged rather than summed over the threads
+    state.counters["ns_per_packet"] = perThread((packets > 0) ? elapsed * 1.0e9 / packets : 0.0);
+    state.counters["allocs_per_packet"] = perThread((packets > 0) ? allocations / packets : 0.0);
+    if ( cache_misses.available() ) {
+      state.counters["cache_misses_per_packet"] = perThread((packets > 0) ? (cache_misses.read() - start_misses) / packets : 0.0);
+    } else {
+      state.SetLabel("no perf counters");
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(packets));
+  }
+
+private:
+  static benchmark::Counter perThread(const double &value) { return benchmark::Counter(value, benchmark::Counter::kAvgThreads); }
+
+  PerfCounter cache_misses;
+  double start_time;
+  unsigned long start_allocations;
+  uint64_t start_misses;
+};
+
+CoreParameters decimatedParameters() {
+  CoreParameters parameters;
+  parameters.sensor_state_rate = 10.0;
+  parameters.joint_state_rate = 10.0;
+  parameters.dock_ir_rate = 10.0;
+  parameters.inertia_rate = 10.0;
+  parameters.odometry_rate = 10.0;
+  return parameters;
+}
+
+} // namespace
+
+/*****************************************************************************
+** Benchmarks
+*****************************************************************************/
+
+/**
+ * Making up the packets, part of every other benchmark below.
+ */
+static void BM_SyntheticStream(benchmark::State &state) {
+  SyntheticStream stream;
+  StreamSnapshot snapshot;
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    stream.next(snapshot);
+    benchmark::DoNotOptimize(snapshot.stamp);
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_SyntheticStream);
+
+/**
+ * The driver thread's share: firmware clock, stream health, odometry and hazards.
+ */
+static void BM_Stamp(benchmark::State &state) {
+  Base base(CoreParameters(), 1, true);
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    base.cycle();
+  }
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    base.stream.next(base.snapshot);
+    base.core.stamp(base.snapshot);
+    base.core.integrate(base.snapshot);
+    base.core.processHazards(base.snapshot, base.sink);
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_Stamp);
+
+/**
+ * The publishing thread's share, everything subscribed and published every packet.
+ */
+static void BM_Process(benchmark::State &state) {
+  Base base(CoreParameters(), 1, true);
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    base.cycle();
+  }
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    base.stream.next(base.snapshot);
+    base.snapshot.stamp = base.snapshot.receive_time;
+    base.core.process(base.snapshot, base.sink);
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_Process);
+
+/**
+ * Everything subscribed, published at 10Hz with the packets in between aggregated.
+ */
+static void BM_ProcessDecimated(benchmark::State &state) {
+  Base base(decimatedParameters(), 1, true);
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    base.cycle();
+  }
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    base.stream.next(base.snapshot);
+    base.snapshot.stamp = base.snapshot.receive_time;
+    base.core.process(base.snapshot, base.sink);
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_ProcessDecimated);
+
+/**
+ * Nobody listening, nothing to aggregate or publish.
+ */
+static void BM_ProcessUnsubscribed(benchmark::State &state) {
+  Base base(CoreParameters(), 1, false);
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    base.cycle();
+  }
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    base.stream.next(base.snapshot);
+    base.snapshot.stamp = base.snapshot.receive_time;
+    base.core.process(base.snapshot, base.sink);
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_ProcessUnsubscribed);
+
+static void BM_OdometryUpdate(benchmark::State &state) {
+  SyntheticStream stream;
+  StreamSnapshot snapshot;
+  OdometryModel odometry;
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    stream.next(snapshot);
+    benchmark::DoNotOptimize(odometry.update(snapshot.receive_time, snapshot.pose_update, snapshot.pose_update_rates,
+                                             snapshot.heading, snapshot.angular_velocity));
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_OdometryUpdate);
+
+static void BM_RawInertiaConversion(benchmark::State &state) {
+  SyntheticStream stream;
+  StreamSnapshot snapshot;
+  RawInertiaSamples samples;
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    stream.next(snapshot);
+    KobukiCore::convertRawInertia(snapshot.raw_inertia, snapshot.receive_time, samples);
+    benchmark::DoNotOptimize(samples.angular_velocity[0][0]);
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+}
+BENCHMARK(BM_RawInertiaConversion);
+
+/**
+ * A full cycle for each of 1 to N bases handled by one thread, how the cost
+ * per packet holds up as the working set outgrows the caches.
+ */
+static void BM_Bases(benchmark::State &state) {
+  std::vector<Base*> bases;
+  for ( int64_t i = 0; i < state.range(0); ++i ) {
+    bases.push_back(new Base(CoreParameters(), static_cast<uint32_t>(i + 1), true));
+  }
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    for ( unsigned int j = 0; j < bases.size(); ++j ) {
+      bases[j]->cycle();
+    }
+  }
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    for ( unsigned int j = 0; j < bases.size(); ++j ) {
+      bases[j]->cycle();
+    }
+  }
+  counters.report(state, static_cast<double>(state.iterations()) * bases.size());
+  for ( unsigned int i = 0; i < bases.size(); ++i ) {
+    delete bases[i];
+  }
+}
+BENCHMARK(BM_Bases)->RangeMultiplier(2)->Range(1, max_bases);
+
+/**
+ * A full cycle for one base per thread, 1 to N threads, for contention
+ * between bases sharing a process.
+ */
+static void BM_BasesThreaded(benchmark::State &state) {
+  Base *base = new Base(CoreParameters(), static_cast<uint32_t>(state.thread_index() + 1), true);
+  for ( unsigned int i = 0; i < warm_up_packets; ++i ) {
+    base->cycle();
+  }
+  PacketCounters counters;
+  while ( state.KeepRunning() ) {
+    base->cycle();
+  }
+  counters.report(state, static_cast<double>(state.iterations()));
+  delete base;
+}
+BENCHMARK(BM_BasesThreaded)->ThreadRange(1, 8)->UseRealTime();
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  static char json_output[] = "--benchmark_out=kobuki_node_bench.json";
+  static char json_format[] = "--benchmark_out_format=json";
+  std::vector<char*> arguments(argv, argv + argc);
+  bool output_given = false;
+  for ( int i = 1; i < argc; ++i ) {
+    output_given = output_given || (strncmp(argv[i], "--benchmark_out=", 16) == 0);
+  }
+  if ( !output_given ) {
+    arguments.push_back(json_output);
+    arguments.push_back(json_format);
+  }
+  int count = static_cast<int>(arguments.size());
+  benchmark::Initialize(&count, &arguments[0]);
+  if ( benchmark::ReportUnrecognizedArguments(count, &arguments[0]) ) {
+    return 1;
+  }
+  if ( !AllocationCounter::available() ) {
+    fprintf(stderr, "kobuki_node_bench : allocations are only counted with glibc\n");
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
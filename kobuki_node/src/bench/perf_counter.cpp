@@ -0,0 +1,61 @@
+/**
+ * @file /kobuki_node/src/bench/perf_counter.cpp
+ *
+ * @brief Hardware cache miss counter of the calling thread.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf_counter.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+PerfCounter::PerfCounter() : descriptor(-1) {
+  perf_event_attr attributes;
+  memset(&attributes, 0, sizeof(attributes));
+  attributes.type = PERF_TYPE_HARDWARE;
+  attributes.size = sizeof(attributes);
+  attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+  attributes.disabled = 1;
+  attributes.exclude_kernel = 1;
+  attributes.exclude_hv = 1;
+  // this thread, any cpu
+  descriptor = static_cast<int>(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+  if ( descriptor >= 0 ) {
+    ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+    ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+PerfCounter::~PerfCounter() {
+  if ( descriptor >= 0 ) {
+    close(descriptor);
+  }
+}
+
+uint64_t PerfCounter::read() const {
+  uint64_t value = 0;
+  if ( (descriptor < 0) || (::read(descriptor, &value, sizeof(value)) != sizeof(value)) ) {
+    return 0;
+  }
+  return value;
+}
+
+} // namespace kobuki
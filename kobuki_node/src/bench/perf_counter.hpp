@@ -0,0 +1,56 @@
+/**
+ * @file /kobuki_node/src/bench/perf_counter.hpp
+ *
+ * @brief Hardware cache miss counter of the calling thread.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_PERF_COUNTER_HPP_
+#define KOBUKI_NODE_PERF_COUNTER_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Counts the last level cache misses of the calling thread.
+ *
+ * Uses the kernel's perf events, which may not be there (no hardware
+ * counters in virtual machines and containers, perf_event_paranoid), in
+ * which case available() is false and read() stays 0.
+ */
+class PerfCounter {
+public:
+  PerfCounter();
+  ~PerfCounter();
+
+  bool available() const { return descriptor >= 0; }
+  uint64_t read() const;
+
+private:
+  PerfCounter(const PerfCounter&);
+  PerfCounter& operator=(const PerfCounter&);
+
+  int descriptor;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_PERF_COUNTER_HPP_ */
@@ -0,0 +1,178 @@
+/**
+ * @file /kobuki_node/src/bench/synthetic_stream.hpp
+ *
+ * @brief Synthetic stream packets and a mock publishing sink.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_SYNTHETIC_STREAM_HPP_
+#define KOBUKI_NODE_SYNTHETIC_STREAM_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+#include "../../include/kobuki_node/compact_sensors.hpp"
+#include "../../include/kobuki_node/stream_sink.hpp"
+#include "../../include/kobuki_node/stream_snapshot.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Makes up the snapshots of a base driving in circles.
+ *
+ * 50Hz packets with a little receive jitter, the encoders and the gyro
+ * moving, two raw gyro samples per packet and the bumper hit every ten
+ * seconds, so every output of the core has something to do. Deterministic
+ * for a given seed.
+ */
+class SyntheticStream {
+public:
+  SyntheticStream(const uint32_t &seed = 1) :
+    random_state(seed ? seed : 1), packets(0), time(1000.0), heading(0.0)
+  {}
+
+  void next(StreamSnapshot &snapshot) {
+    ++packets;
+    time += 0.02;
+    heading += 0.001;
+
+    snapshot.receive_time = time + 0.002 * (random() & 0xff) / 255.0; // up to 2ms late
+    CoreSensors::Data &core = snapshot.core_sensors;
+    core.time_stamp = static_cast<uint16_t>(core.time_stamp + 20);
+    core.left_encoder = static_cast<uint16_t>(core.left_encoder + 11);
+    core.right_encoder = static_cast<uint16_t>(core.right_encoder + 13);
+    core.bumper = ((packets % 500) < 5) ? CoreSensors::Flags::CenterBumper : 0;
+    core.battery = 160;
+    for ( unsigned int i = 0; i < snapshot.cliff.bottom.size(); ++i ) {
+      snapshot.cliff.bottom[i] = static_cast<uint16_t>(2000 + (random() & 0x3f));
+    }
+    for ( unsigned int i = 0; i < snapshot.current.current.size(); ++i ) {
+      snapshot.current.current[i] = static_cast<uint8_t>(random() & 0x0f);
+    }
+    for ( unsigned int i = 0; i < snapshot.dock_ir.docking.size(); ++i ) {
+      snapshot.dock_ir.docking[i] = static_cast<uint8_t>(((packets % 3) == i) ? random() & 0x3f : 0);
+    }
+    ThreeAxisGyro::Data &gyro = snapshot.raw_inertia;
+    gyro.frame_id = static_cast<uint8_t>(gyro.frame_id + 2);
+    gyro.followed_data_length = 6;
+    for ( unsigned int i = 0; i < 6; ++i ) {
+      gyro.data[i] = static_cast<uint16_t>(random() & 0x3ff);
+    }
+
+    snapshot.pose_update = ecl::LegacyPose2D<double>(0.002, 0.0, 0.001);
+    snapshot.pose_update_rates << 0.1, 0.0, 0.05;
+    snapshot.heading = heading;
+    snapshot.angular_velocity = 0.05;
+    snapshot.wheel_left_position += 0.015;
+    snapshot.wheel_left_velocity = 0.75;
+    snapshot.wheel_right_position += 0.018;
+    snapshot.wheel_right_velocity = 0.9;
+  }
+
+private:
+  uint32_t random() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+  }
+
+  uint32_t random_state;
+  unsigned long packets;
+  double time;    // [s]
+  double heading; // [rad]
+};
+
+/**
+ * @brief Stands in for the ros publishers.
+ *
+ * Fills plain structs laid out like the pooled messages, the way the node
+ * fills its messages, minus the serialisation.
+ */
+class MockSink : public StreamSink {
+public:
+  MockSink(const bool &subscribed_to_all = true) : subscribed_to_all(subscribed_to_all), published(0) {
+    memset(&sensor_state, 0, sizeof(sensor_state));
+    memset(&imu, 0, sizeof(imu));
+    memset(compact, 0, sizeof(compact));
+    memset(joint_state, 0, sizeof(joint_state));
+    memset(dock_ir, 0, sizeof(dock_ir));
+  }
+
+  bool subscribed(const StreamOutput::Type &/*output*/) const { return subscribed_to_all; }
+
+  void publishSensorState(const StreamSnapshot &snapshot, const SensorStateWindow &window) {
+    sensor_state.stamp = snapshot.stamp;
+    sensor_state.time_stamp = snapshot.core_sensors.time_stamp;
+    sensor_state.bumper = window.bumper;
+    sensor_state.cliff = window.cliff;
+    sensor_state.left_encoder = snapshot.core_sensors.left_encoder;
+    sensor_state.right_encoder = snapshot.core_sensors.right_encoder;
+    for ( unsigned int i = 0; i < 3 && i < window.bottom_min.size(); ++i ) {
+      sensor_state.bottom[i] = window.bottom_min[i];
+    }
+    ++published;
+  }
+  void publishCompactSensorState(const uint8_t *frame, const size_t &size) {
+    memcpy(compact, frame, size);
+    ++published;
+  }
+  void publishJointState(const StreamSnapshot &snapshot) {
+    joint_state[0] = snapshot.wheel_left_position;
+    joint_state[1] = snapshot.wheel_right_position;
+    ++published;
+  }
+  void publishInertia(const StreamSnapshot &snapshot, const InertiaWindow &window) {
+    imu.stamp = snapshot.stamp;
+    imu.angular_velocity[2] = window.angularVelocity();
+    ++published;
+  }
+  void publishRawInertia(const RawInertiaSamples &samples) {
+    for ( unsigned int i = 0; i < samples.size; ++i ) {
+      imu.stamp = samples.stamp[i];
+      imu.angular_velocity[0] = samples.angular_velocity[i][0];
+      imu.angular_velocity[1] = samples.angular_velocity[i][1];
+      imu.angular_velocity[2] = samples.angular_velocity[i][2];
+      ++published;
+    }
+  }
+  void publishDockIR(const StreamSnapshot &/*snapshot*/, const DockIRWindow &window) {
+    memcpy(dock_ir, window.docking, sizeof(dock_ir));
+    ++published;
+  }
+  void publishOdometry(const OdometryState &state) { odometry = state; ++published; }
+  void publishTransform(const OdometryState &state) { odometry = state; ++published; }
+  void publishHazardState(const HazardTransition &transition) { hazards = transition; ++published; }
+
+  bool subscribed_to_all;
+  unsigned long published;
+
+private:
+  struct { double stamp; uint16_t time_stamp; uint8_t bumper, cliff; uint16_t left_encoder, right_encoder, bottom[3]; } sensor_state;
+  struct { double stamp; double angular_velocity[3]; } imu;
+  OdometryState odometry;
+  HazardTransition hazards;
+  uint8_t compact[CompactSensorFormat::max_frame_size];
+  double joint_state[2];
+  uint8_t dock_ir[3];
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_SYNTHETIC_STREAM_HPP_ */
@@ -0,0 +1,191 @@
+/**
+ * @file /src/codec/compact_sensors.cpp
+ *
+ * @brief Compact binary encoding of the kobuki core sensors.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <string.h>
+#include "../../include/kobuki_node/compact_sensors.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+
+using namespace CompactSensorFormat;
+
+const size_t field_sizes[NumberOfFields] = { 2, 4, 4, 2, 3, 6, 2, 2, 8 };
+
+void put16(uint8_t *&buffer, const uint16_t &value) {
+  *buffer++ = static_cast<uint8_t>(value & 0xff);
+  *buffer++ = static_cast<uint8_t>(value >> 8);
+}
+
+uint16_t get16(const uint8_t *&buffer) {
+  uint16_t value = static_cast<uint16_t>(buffer[0]) | (static_cast<uint16_t>(buffer[1]) << 8);
+  buffer += 2;
+  return value;
+}
+
+bool fieldEquals(const Field &field, const CompactSensorState &a, const CompactSensorState &b) {
+  switch (field) {
+    case TimeStamp   : return a.time_stamp == b.time_stamp;
+    case Events      : return (a.bumper == b.bumper) && (a.wheel_drop == b.wheel_drop) &&
+                              (a.cliff == b.cliff) && (a.buttons == b.buttons);
+    case Encoders    : return (a.left_encoder == b.left_encoder) && (a.right_encoder == b.right_encoder);
+    case Pwm         : return (a.left_pwm == b.left_pwm) && (a.right_pwm == b.right_pwm);
+    case Power       : return (a.charger == b.charger) && (a.battery == b.battery) &&
+                              (a.over_current == b.over_current);
+    case CliffBottom : return memcmp(a.bottom, b.bottom, sizeof(a.bottom)) == 0;
+    case Current     : return memcmp(a.current, b.current, sizeof(a.current)) == 0;
+    case DigitalIn   : return a.digital_input == b.digital_input;
+    case AnalogIn    : return memcmp(a.analog_input, b.analog_input, sizeof(a.analog_input)) == 0;
+    default: return true;
+  }
+}
+
+void writeField(const Field &field, const CompactSensorState &state, uint8_t *&buffer) {
+  switch (field) {
+    case TimeStamp   : put16(buffer, state.time_stamp); break;
+    case Events      : *buffer++ = state.bumper; *buffer++ = state.wheel_drop;
+                       *buffer++ = state.cliff; *buffer++ = state.buttons; break;
+    case Encoders    : put16(buffer, state.left_encoder); put16(buffer, state.right_encoder); break;
+    case Pwm         : *buffer++ = static_cast<uint8_t>(state.left_pwm);
+                       *buffer++ = static_cast<uint8_t>(state.right_pwm); break;
+    case Power       : *buffer++ = state.charger; *buffer++ = state.battery; *buffer++ = state.over_current; break;
+    case CliffBottom : for ( unsigned int i = 0; i < 3; ++i ) { put16(buffer, state.bottom[i]); } break;
+    case Current     : *buffer++ = state.current[0]; *buffer++ = state.current[1]; break;
+    case DigitalIn   : put16(buffer, state.digital_input); break;
+    case AnalogIn    : for ( unsigned int i = 0; i < 4; ++i ) { put16(buffer, state.analog_input[i]); } break;
+    default: break;
+  }
+}
+
+void readField(const Field &field, const uint8_t *&buffer, CompactSensorState &state) {
+  switch (field) {
+    case TimeStamp   : state.time_stamp = get16(buffer); break;
+    case Events      : state.bumper = *buffer++; state.wheel_drop = *buffer++;
+                       state.cliff = *buffer++; state.buttons = *buffer++; break;
+    case Encoders    : state.left_encoder = get16(buffer); state.right_encoder = get16(buffer); break;
+    case Pwm         : state.left_pwm = static_cast<int8_t>(*buffer++);
+                       state.right_pwm = static_cast<int8_t>(*buffer++); break;
+    case Power       : state.charger = *buffer++; state.battery = *buffer++; state.over_current = *buffer++; break;
+    case CliffBottom : for ( unsigned int i = 0; i < 3; ++i ) { state.bottom[i] = get16(buffer); } break;
+    case Current     : state.current[0] = *buffer++; state.current[1] = *buffer++; break;
+    case DigitalIn   : state.digital_input = get16(buffer); break;
+    case AnalogIn    : for ( unsigned int i = 0; i < 4; ++i ) { state.analog_input[i] = get16(buffer); } break;
+    default: break;
+  }
+}
+
+} // namespace
+
+/*****************************************************************************
+** Implementation [CompactSensorState]
+*****************************************************************************/
+
+CompactSensorState::CompactSensorState() {
+  memset(this, 0, sizeof(CompactSensorState)); // plain old data
+}
+
+/*****************************************************************************
+** Implementation [CompactSensorEncoder]
+*****************************************************************************/
+
+CompactSensorEncoder::CompactSensorEncoder(const unsigned int &key_frame_interval) :
+  key_frame_interval(key_frame_interval),
+  frames_to_key_frame(0),
+  sequence(0)
+{}
+
+size_t CompactSensorEncoder::encode(const CompactSensorState &state, uint8_t *buffer) {
+  const bool key_frame = (frames_to_key_frame == 0);
+  uint16_t mask = 0;
+  for ( unsigned int i = 0; i < NumberOfFields; ++i ) {
+    if ( key_frame || !fieldEquals(static_cast<Field>(i), state, previous) ) {
+      mask |= (1 << i);
+    }
+  }
+
+  uint8_t *cursor = buffer;
+  *cursor++ = CompactSensorFormat::version;
+  *cursor++ = key_frame ? key_frame_flag : 0;
+  put16(cursor, sequence);
+  put16(cursor, mask);
+  for ( unsigned int i = 0; i < NumberOfFields; ++i ) {
+    if ( mask & (1 << i) ) {
+      writeField(static_cast<Field>(i), state, cursor);
+    }
+  }
+
+  previous = state;
+  ++sequence;
+  frames_to_key_frame = key_frame ? key_frame_interval : frames_to_key_frame;
+  if ( frames_to_key_frame > 0 ) {
+    --frames_to_key_frame;
+  }
+  return static_cast<size_t>(cursor - buffer);
+}
+
+/*****************************************************************************
+** Implementation [CompactSensorDecoder]
+*****************************************************************************/
+
+CompactSensorDecoder::CompactSensorDecoder() :
+  synchronised(false),
+  sequence(0),
+  lost_frames(0)
+{}
+
+bool CompactSensorDecoder::decode(const uint8_t *buffer, const size_t &size, CompactSensorState &state) {
+  if ( (size < header_size) || (buffer[0] != CompactSensorFormat::version) ) {
+    return false;
+  }
+  const uint8_t *cursor = buffer + 2;
+  const uint16_t frame_sequence = get16(cursor);
+  const uint16_t mask = get16(cursor);
+  const bool key_frame = (buffer[1] & key_frame_flag) != 0;
+
+  size_t expected_size = header_size;
+  for ( unsigned int i = 0; i < NumberOfFields; ++i ) {
+    if ( mask & (1 << i) ) {
+      expected_size += field_sizes[i];
+    }
+  }
+  if ( size != expected_size ) {
+    return false;
+  }
+
+  if ( synchronised && (frame_sequence != static_cast<uint16_t>(sequence + 1)) ) {
+    lost_frames += static_cast<uint16_t>(frame_sequence - sequence - 1);
+    synchronised = false;
+  }
+  sequence = frame_sequence;
+  if ( !synchronised && !key_frame ) {
+    return false; // can't apply a delta to a state we don't have
+  }
+
+  for ( unsigned int i = 0; i < NumberOfFields; ++i ) {
+    if ( mask & (1 << i) ) {
+      readField(static_cast<Field>(i), cursor, current);
+    }
+  }
+  synchronised = true;
+  state = current;
+  return true;
+}
+
+} // namespace kobuki
@@ -0,0 +1,329 @@
+/**
+ * @file /src/codec/raw_recording.cpp
+ *
+ * @brief Memory mapped ring recording of the raw serial traffic.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <utility>
+#include "../../include/kobuki_node/raw_recording.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+
+using namespace RawRecordingFormat;
+
+size_t aligned(const size_t &size) {
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+bool makeDirectories(const std::string &directory) {
+  std::string::size_type slash = 0;
+  while ( slash != std::string::npos ) {
+    slash = directory.find('/', slash + 1);
+    const std::string path = directory.substr(0, slash);
+    if ( !path.empty() && (mkdir(path.c_str(), 0755) != 0) && (errno != EEXIST) ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Header of an existing segment file.
+ *
+ * @return bool : false if missing or not a segment.
+ */
+bool readSegmentHeader(const std::string &file_name, SegmentHeader &header) {
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if ( fd < 0 ) {
+    return false;
+  }
+  const ssize_t result = ::read(fd, &header, sizeof(header));
+  ::close(fd);
+  return (result == static_cast<ssize_t>(sizeof(header))) &&
+         (memcmp(header.magic, magic, sizeof(magic)) == 0) &&
+         (header.version == version);
+}
+
+std::string systemError(const std::string &what, const std::string &file_name) {
+  return what + " [" + file_name + "][" + strerror(errno) + "]";
+}
+
+} // namespace
+
+std::string RawRecordingFormat::segmentFileName(const std::string &directory, const unsigned int &index) {
+  char file_name[32];
+  snprintf(file_name, sizeof(file_name), "/segment_%03u.kraw", index);
+  return directory + file_name;
+}
+
+/*****************************************************************************
+** Implementation [RawRecorder]
+*****************************************************************************/
+
+RawRecorder::RawRecorder() :
+  segment_size(0),
+  segments(0),
+  index(0),
+  sequence(0),
+  segment(NULL),
+  pending(0),
+  record_count(0),
+  rotation_count(0),
+  dropped_count(0)
+{}
+
+RawRecorder::~RawRecorder() {
+  close();
+}
+
+bool RawRecorder::open(const std::string &new_directory, const size_t &new_segment_size,
+                       const unsigned int &new_segments) {
+  close();
+  if ( (new_segments == 0) || (new_segment_size < header_size + record_header_size + 256) ) {
+    error_message = "segment count or size too small";
+    return false;
+  }
+  if ( !makeDirectories(new_directory) ) {
+    error_message = systemError("could not create the directory", new_directory);
+    return false;
+  }
+  directory = new_directory;
+  segment_size = new_segment_size;
+  segments = new_segments;
+
+  // continue after the newest segment of a previous recording
+  uint64_t newest = 0;
+  unsigned int newest_index = segments - 1;
+  for ( unsigned int i = 0; i < segments; ++i ) {
+    SegmentHeader header;
+    if ( readSegmentHeader(segmentFileName(directory, i), header) && (header.sequence > newest) ) {
+      newest = header.sequence;
+      newest_index = i;
+    }
+  }
+  sequence = newest + 1;
+  return startSegment((newest_index + 1) % segments);
+}
+
+void RawRecorder::close() {
+  unmapSegment();
+}
+
+unsigned char* RawRecorder::reserve(const RecordType &type, const int64_t &host_time,
+                                    const uint16_t &firmware_stamp, const size_t &length) {
+  const size_t size = aligned(record_header_size + length);
+  if ( (segment == NULL) || (size > segment_size - header_size) ) {
+    ++dropped_count;
+    return NULL;
+  }
+  SegmentHeader *header = reinterpret_cast<SegmentHeader*>(segment);
+  if ( header->used + size > segment_size ) {
+    unmapSegment();
+    ++sequence;
+    ++rotation_count;
+    if ( !startSegment((index + 1) % segments) ) {
+      ++dropped_count;
+      return NULL;
+    }
+    header = reinterpret_cast<SegmentHeader*>(segment);
+  }
+  RecordHeader record;
+  record.length = static_cast<uint16_t>(length);
+  record.type = static_cast<uint8_t>(type);
+  record.flags = 0;
+  record.firmware_stamp = firmware_stamp;
+  record.reserved = 0;
+  record.host_time = host_time;
+  unsigned char *position = segment + header->used;
+  memcpy(position, &record, sizeof(record));
+  pending = size;
+  return position + record_header_size;
+}
+
+void RawRecorder::commit() {
+  SegmentHeader *header = reinterpret_cast<SegmentHeader*>(segment);
+  __sync_synchronize(); // the record is complete before it is counted, even if we crash right here
+  header->used += pending;
+  pending = 0;
+  ++record_count;
+}
+
+bool RawRecorder::startSegment(const unsigned int &new_index) {
+  const std::string file_name = segmentFileName(directory, new_index);
+  int fd = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+  if ( fd < 0 ) {
+    error_message = systemError("could not open", file_name);
+    return false;
+  }
+  if ( ftruncate(fd, segment_size) != 0 ) {
+    error_message = systemError("could not resize", file_name);
+    ::close(fd);
+    return false;
+  }
+  void *mapping = mmap(NULL, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping keeps the file
+  if ( mapping == MAP_FAILED ) {
+    error_message = systemError("could not map", file_name);
+    return false;
+  }
+  segment = static_cast<unsigned char*>(mapping);
+  index = new_index;
+
+  SegmentHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.header_size = header_size;
+  header.sequence = sequence;
+  header.size = segment_size;
+  header.used = header_size;
+  memcpy(segment, &header, sizeof(header));
+  return true;
+}
+
+void RawRecorder::unmapSegment() {
+  if ( segment != NULL ) {
+    msync(segment, segment_size, MS_ASYNC);
+    munmap(segment, segment_size);
+    segment = NULL;
+  }
+}
+
+/*****************************************************************************
+** Implementation [RawRecordingReader]
+*****************************************************************************/
+
+RawRecordingReader::RawRecordingReader() :
+  position(0),
+  segment(NULL),
+  segment_size(0),
+  offset(0),
+  used(0)
+{}
+
+RawRecordingReader::~RawRecordingReader() {
+  close();
+}
+
+bool RawRecordingReader::open(const std::string &directory) {
+  close();
+  std::vector<std::pair<uint64_t, std::string> > found;
+  for ( unsigned int i = 0; ; ++i ) {
+    const std::string file_name = segmentFileName(directory, i);
+    if ( access(file_name.c_str(), F_OK) != 0 ) {
+      break; // segments are created in order
+    }
+    SegmentHeader header;
+    if ( readSegmentHeader(file_name, header) ) {
+      found.push_back(std::make_pair(header.sequence, file_name));
+    }
+  }
+  if ( found.empty() ) {
+    error_message = "no recording found [" + directory + "]";
+    return false;
+  }
+  std::sort(found.begin(), found.end());
+  for ( unsigned int i = 0; i < found.size(); ++i ) {
+    files.push_back(found[i].second);
+  }
+  rewind();
+  return true;
+}
+
+void RawRecordingReader::close() {
+  unmapSegment();
+  files.clear();
+}
+
+void RawRecordingReader::rewind() {
+  unmapSegment();
+  position = 0;
+  while ( (position < files.size()) && !mapSegment(position) ) {
+    ++position;
+  }
+}
+
+bool RawRecordingReader::next(RawRecord &record) {
+  while ( segment != NULL ) {
+    if ( offset + record_header_size <= used ) {
+      RecordHeader header;
+      memcpy(&header, segment + offset, sizeof(header));
+      const size_t size = aligned(record_header_size + header.length);
+      if ( offset + size <= used ) {
+        record.type = static_cast<RecordType>(header.type);
+        record.firmware_stamp = header.firmware_stamp;
+        record.host_time = header.host_time;
+        record.data = segment + offset + record_header_size;
+        record.size = header.length;
+        offset += size;
+        return true;
+      }
+    }
+    // end of this segment, on to the next one that maps
+    unmapSegment();
+    while ( (++position < files.size()) && !mapSegment(position) ) {}
+  }
+  return false;
+}
+
+bool RawRecordingReader::mapSegment(const unsigned int &new_position) {
+  const std::string &file_name = files[new_position];
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if ( fd < 0 ) {
+    error_message = systemError("could not open", file_name);
+    return false;
+  }
+  struct stat status;
+  if ( (fstat(fd, &status) != 0) || (static_cast<size_t>(status.st_size) < header_size) ) {
+    error_message = "not a segment [" + file_name + "]";
+    ::close(fd);
+    return false;
+  }
+  void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if ( mapping == MAP_FAILED ) {
+    error_message = systemError("could not map", file_name);
+    return false;
+  }
+  segment = static_cast<unsigned char*>(mapping);
+  segment_size = status.st_size;
+  SegmentHeader header;
+  memcpy(&header, segment, sizeof(header));
+  offset = header_size;
+  used = std::min(static_cast<size_t>(header.used), segment_size);
+  return true;
+}
+
+void RawRecordingReader::unmapSegment() {
+  if ( segment != NULL ) {
+    munmap(segment, segment_size);
+    segment = NULL;
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,223 @@
+/**
+ * @file /src/codec/raw_replay.cpp
+ *
+ * @brief Replays a raw recording on a pseudo terminal.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include "../../include/kobuki_node/raw_replay.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+
+const int poll_period = 100; // [ms] how often a waiting replay checks for stop()
+
+int64_t monotonicTime() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Indexable view of a record's packet bytes.
+ */
+struct PacketView {
+  PacketView(const RawRecord &record) : record(record) {}
+  size_t size() const { return record.size; }
+  unsigned char operator[](const size_t &i) const { return record.data[i]; }
+  const RawRecord &record;
+};
+
+} // namespace
+
+/*****************************************************************************
+** Implementation [RawReplay]
+*****************************************************************************/
+
+RawReplay::RawReplay() :
+  speed(1.0),
+  loop(false),
+  master(-1),
+  slave(-1),
+  start_time(0),
+  start_stamp(0),
+  stop_requested(false),
+  is_finished(false),
+  packet_count(0),
+  loop_count(0)
+{}
+
+RawReplay::~RawReplay() {
+  close();
+}
+
+bool RawReplay::open(const std::string &directory, const double &new_speed, const bool &new_loop) {
+  close();
+  speed = new_speed;
+  loop = new_loop;
+  if ( !reader.open(directory) ) {
+    error_message = reader.error();
+    return false;
+  }
+  RawRecord record;
+  bool found = false;
+  while ( !found && reader.next(record) ) {
+    found = (record.type == RawRecordingFormat::Stream);
+  }
+  if ( !found ) {
+    error_message = "no stream packets in the recording [" + directory + "]";
+    return false;
+  }
+  start_time = record.host_time;
+  start_stamp = 0;
+  PacketView packet(record);
+  rawPacketTimeStamp(packet, start_stamp);
+  reader.rewind();
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ( (master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0) ) {
+    error_message = std::string("could not open a pseudo terminal [") + strerror(errno) + "]";
+    close();
+    return false;
+  }
+  device_port = ptsname(master);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  // held open for the whole replay so the terminal stays raw and the master
+  // doesn't hang up while the driver reconnects
+  slave = ::open(device_port.c_str(), O_RDWR | O_NOCTTY);
+  termios attributes;
+  if ( (slave < 0) || (tcgetattr(slave, &attributes) != 0) ) {
+    error_message = "could not open the pseudo terminal [" + device_port + "][" + strerror(errno) + "]";
+    close();
+    return false;
+  }
+  cfmakeraw(&attributes);
+  tcsetattr(slave, TCSANOW, &attributes);
+  return true;
+}
+
+void RawReplay::close() {
+  if ( slave >= 0 ) {
+    ::close(slave);
+    slave = -1;
+  }
+  if ( master >= 0 ) {
+    ::close(master);
+    master = -1;
+  }
+  reader.close();
+}
+
+void RawReplay::run() {
+  if ( !waitForDriver() ) {
+    return;
+  }
+  RawRecord record;
+  int64_t origin = 0;      // monotonic time the first packet of this pass went out
+  int64_t first_time = -1; // recorded time of that packet
+  unsigned long pass_packets = 0;
+  while ( !stopping() ) {
+    if ( !reader.next(record) ) {
+      if ( !loop || (pass_packets == 0) ) {
+        break;
+      }
+      reader.rewind();
+      loop_count.fetch_add(1, boost::memory_order_relaxed);
+      first_time = -1;
+      pass_packets = 0;
+      continue;
+    }
+    if ( record.type != RawRecordingFormat::Stream ) {
+      continue;
+    }
+    if ( speed > 0.0 ) {
+      if ( first_time < 0 ) {
+        first_time = record.host_time;
+        origin = monotonicTime();
+      }
+      const int64_t due = origin + static_cast<int64_t>((record.host_time - first_time) / speed);
+      for ( int64_t now = monotonicTime(); (now < due) && !stopping(); now = monotonicTime() ) {
+        drainCommands();
+        const int64_t wait = std::min<int64_t>(due - now, poll_period * 1000000LL);
+        timespec duration = { static_cast<time_t>(wait / 1000000000LL), static_cast<long>(wait % 1000000000LL) };
+        nanosleep(&duration, NULL);
+      }
+    }
+    if ( !writePacket(record.data, record.size) ) {
+      break;
+    }
+    packet_count.fetch_add(1, boost::memory_order_relaxed);
+    ++pass_packets;
+  }
+  is_finished.store(true, boost::memory_order_release);
+  while ( !stopping() ) {
+    // keep the driver's writes from blocking on a full terminal
+    pollfd descriptor = { master, POLLIN, 0 };
+    poll(&descriptor, 1, poll_period);
+    drainCommands();
+  }
+}
+
+bool RawReplay::waitForDriver() {
+  while ( !stopping() ) {
+    pollfd descriptor = { master, POLLIN, 0 };
+    if ( (poll(&descriptor, 1, poll_period) > 0) && (descriptor.revents & POLLIN) ) {
+      drainCommands();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RawReplay::writePacket(const unsigned char *data, const size_t &size) {
+  size_t written = 0;
+  while ( (written < size) && !stopping() ) {
+    pollfd descriptor = { master, POLLIN | POLLOUT, 0 };
+    if ( poll(&descriptor, 1, poll_period) <= 0 ) {
+      continue; // reader is behind (or reconnecting), the terminal is full
+    }
+    if ( descriptor.revents & POLLIN ) {
+      drainCommands();
+    }
+    if ( descriptor.revents & POLLOUT ) {
+      const ssize_t result = ::write(master, data + written, size - written);
+      if ( result > 0 ) {
+        written += result;
+      } else if ( (result < 0) && (errno != EAGAIN) && (errno != EINTR) ) {
+        error_message = std::string("could not write to the pseudo terminal [") + strerror(errno) + "]";
+        return false;
+      }
+    }
+  }
+  return written == size;
+}
+
+void RawReplay::drainCommands() {
+  unsigned char buffer[256];
+  while ( ::read(master, buffer, sizeof(buffer)) > 0 ) {}
+}
+
+} // namespace kobuki
@@ -0,0 +1,222 @@
+/**
+ * @file /src/core/command_latency.cpp
+ *
+ * @brief Velocity command tracing implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include "../../include/kobuki_node/command_latency.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const unsigned int sub_buckets = 32;    // buckets per power of two
+const unsigned int sub_bucket_bits = 5;
+const unsigned int pending_capacity = 32;
+// odometry noise is about one encoder tick per packet, ~0.005m/s and ~0.02rad/s
+const double linear_motion_threshold = 0.02;  // [m/s]
+const double angular_motion_threshold = 0.1;  // [rad/s]
+const double motion_timeout = 1.0;            // [s]
+}
+
+/*****************************************************************************
+** Implementation [LatencyHistogram]
+*****************************************************************************/
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+void LatencyHistogram::reset() {
+  for ( unsigned int i = 0; i < number_of_buckets; ++i ) {
+    buckets[i].store(0, boost::memory_order_relaxed);
+  }
+  total.store(0, boost::memory_order_relaxed);
+  maximum.store(0, boost::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(const double &latency) {
+  const uint64_t microseconds = (latency > 0.0) ? static_cast<uint64_t>(latency * 1.0e6 + 0.5) : 0;
+  buckets[bucketIndex(microseconds)].fetch_add(1, boost::memory_order_relaxed);
+  total.fetch_add(1, boost::memory_order_relaxed);
+  uint64_t current = maximum.load(boost::memory_order_relaxed);
+  while ( microseconds > current &&
+          !maximum.compare_exchange_weak(current, microseconds, boost::memory_order_relaxed) ) {}
+}
+
+unsigned long LatencyHistogram::read(uint32_t *counts) const {
+  unsigned long sum = 0;
+  for ( unsigned int i = 0; i < number_of_buckets; ++i ) {
+    counts[i] = buckets[i].load(boost::memory_order_relaxed);
+    sum += counts[i];
+  }
+  return sum;
+}
+
+double LatencyHistogram::quantile(const uint32_t *counts, const unsigned long &total, const double &q) {
+  if ( total == 0 ) {
+    return 0.0;
+  }
+  unsigned long rank = static_cast<unsigned long>(std::ceil(q * total));
+  if ( rank == 0 ) {
+    rank = 1;
+  }
+  unsigned long seen = 0;
+  for ( unsigned int i = 0; i < number_of_buckets; ++i ) {
+    seen += counts[i];
+    if ( seen >= rank ) {
+      const double width = (i < 2 * sub_buckets) ? 1.0e-6 : (1 << (i / sub_buckets - 1)) * 1.0e-6;
+      return bucketValue(i) + width / 2.0;
+    }
+  }
+  return bucketValue(number_of_buckets - 1);
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const {
+  uint32_t counts[number_of_buckets];
+  Summary summary;
+  summary.count = read(counts);
+  summary.max = max();
+  // bucket middles can overshoot the exact maximum
+  summary.p50 = std::min(quantile(counts, summary.count, 0.5), summary.max);
+  summary.p90 = std::min(quantile(counts, summary.count, 0.9), summary.max);
+  summary.p99 = std::min(quantile(counts, summary.count, 0.99), summary.max);
+  return summary;
+}
+
+double LatencyHistogram::bucketValue(const unsigned int &bucket) {
+  if ( bucket < 2 * sub_buckets ) {
+    return bucket * 1.0e-6;
+  }
+  const unsigned int shift = bucket / sub_buckets - 1;
+  const uint64_t mantissa = bucket - shift * sub_buckets;
+  return static_cast<double>(mantissa << shift) * 1.0e-6;
+}
+
+unsigned int LatencyHistogram::bucketIndex(const uint64_t &microseconds) {
+  if ( microseconds < 2 * sub_buckets ) {
+    return static_cast<unsigned int>(microseconds);
+  }
+  unsigned int most_significant_bit = 0;
+  for ( uint64_t value = microseconds; value > 1; value >>= 1 ) {
+    ++most_significant_bit;
+  }
+  const unsigned int shift = most_significant_bit - sub_bucket_bits;
+  const unsigned int index = shift * sub_buckets + static_cast<unsigned int>(microseconds >> shift);
+  return (index < number_of_buckets) ? index : number_of_buckets - 1;
+}
+
+/*****************************************************************************
+** Implementation [CommandLatencyTracer]
+*****************************************************************************/
+
+CommandLatencyTracer::CommandLatencyTracer() :
+  tags(0),
+  awaiting_motion(false),
+  baseline_linear(0.0), baseline_angular(0.0),
+  measured_linear(0.0), measured_angular(0.0),
+  motion_timeouts(0)
+{
+  pending.init(pending_capacity);
+}
+
+const char* CommandLatencyTracer::stageName(const Stage &stage) {
+  switch ( stage ) {
+    case ( Applied ) : return "Applied";
+    case ( Sent ) : return "Sent";
+    case ( Motion ) : return "Motion";
+    default : return "Unknown";
+  }
+}
+
+uint32_t CommandLatencyTracer::commandApplied(const double &received, const double &applied,
+                                              const double &linear, const double &angular) {
+  Trace trace;
+  trace.tag = tags.fetch_add(1, boost::memory_order_relaxed) + 1;
+  trace.received = received;
+  trace.linear = linear;
+  trace.angular = angular;
+  histograms[Applied].record(applied - received);
+  // pushed after setBaseControl() so it can't be matched with an earlier send
+  pending.push(trace);
+  return trace.tag;
+}
+
+void CommandLatencyTracer::commandSent(const double &now) {
+  const Trace *trace = pending.front();
+  if ( trace == NULL ) {
+    return;
+  }
+  Trace previous = target;
+  while ( trace != NULL ) {
+    // every command applied since the last send went out with this one
+    histograms[Sent].record(now - trace->received);
+    target = *trace;
+    pending.pop();
+    trace = pending.front();
+  }
+  if ( std::fabs(target.linear - previous.linear) > 2.0 * linear_motion_threshold ||
+       std::fabs(target.angular - previous.angular) > 2.0 * angular_motion_threshold ) {
+    moving = target;
+    awaiting_motion = true;
+    baseline_linear = measured_linear;
+    baseline_angular = measured_angular;
+  }
+}
+
+void CommandLatencyTracer::motionMeasured(const double &now, const double &linear, const double &angular) {
+  measured_linear = linear;
+  measured_angular = angular;
+  if ( !awaiting_motion ) {
+    return;
+  }
+  if ( now - moving.received > motion_timeout ) {
+    // motors disabled, robot blocked or a step too small to see
+    motion_timeouts.fetch_add(1, boost::memory_order_relaxed);
+    awaiting_motion = false;
+    return;
+  }
+  const double linear_step = moving.linear - baseline_linear;
+  const double angular_step = moving.angular - baseline_angular;
+  bool moved = false;
+  if ( std::fabs(linear_step) > 2.0 * linear_motion_threshold ) {
+    moved |= (linear - baseline_linear) * (linear_step > 0.0 ? 1.0 : -1.0) > linear_motion_threshold;
+  }
+  if ( std::fabs(angular_step) > 2.0 * angular_motion_threshold ) {
+    moved |= (angular - baseline_angular) * (angular_step > 0.0 ? 1.0 : -1.0) > angular_motion_threshold;
+  }
+  if ( moved ) {
+    histograms[Motion].record(now - moving.received);
+    awaiting_motion = false;
+  }
+}
+
+/*****************************************************************************
+** Implementation [CommandAgeFilter]
+*****************************************************************************/
+
+bool CommandAgeFilter::accept(const double &age) {
+  ages.record(age); // stamps from the future (unsynchronised clocks) count as 0
+  if ( (max_age > 0.0) && (age > max_age) ) {
+    stale.fetch_add(1, boost::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+} // namespace kobuki
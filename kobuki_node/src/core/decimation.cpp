@@ -0,0 +1,76 @@
+/**
+ * @file /src/core/decimation.cpp
+ *
+ * @brief Rate decimation and windowed aggregation implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include "../../include/kobuki_node/decimation.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation [Decimator]
+*****************************************************************************/
+
+bool Decimator::update(const double &stamp) {
+  if ( period <= 0.0 ) {
+    return true;
+  }
+  const double tolerance = 0.001; // packet stamps come in whole firmware milliseconds
+  if ( !started ) {
+    started = true;
+    next_window = stamp + period;
+    return true;
+  }
+  if ( stamp < next_window - tolerance ) {
+    return false;
+  }
+  next_window += period;
+  if ( next_window <= stamp ) {
+    next_window = stamp + period; // fell behind (stream gap), don't burst to catch up
+  }
+  return true;
+}
+
+/*****************************************************************************
+** Implementation [SensorStateWindow]
+*****************************************************************************/
+
+void SensorStateWindow::add(const StreamSnapshot &snapshot) {
+  const CoreSensors::Data &data = snapshot.core_sensors;
+  if ( samples == 0 ) {
+    bumper = data.bumper;
+    wheel_drop = data.wheel_drop;
+    cliff = data.cliff;
+    buttons = data.buttons;
+    over_current = data.over_current;
+    bottom_min = snapshot.cliff.bottom; // only allocates the very first time
+    current_max = snapshot.current.current;
+  } else {
+    bumper |= data.bumper;
+    wheel_drop |= data.wheel_drop;
+    cliff |= data.cliff;
+    buttons |= data.buttons;
+    over_current |= data.over_current;
+    for ( unsigned int i = 0; i < bottom_min.size() && i < snapshot.cliff.bottom.size(); ++i ) {
+      bottom_min[i] = std::min(bottom_min[i], snapshot.cliff.bottom[i]);
+    }
+    for ( unsigned int i = 0; i < current_max.size() && i < snapshot.current.current.size(); ++i ) {
+      current_max[i] = std::max(current_max[i], snapshot.current.current[i]);
+    }
+  }
+  ++samples;
+}
+
+} // namespace kobuki
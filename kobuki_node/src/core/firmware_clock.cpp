@@ -0,0 +1,125 @@
+/**
+ * @file /src/core/firmware_clock.cpp
+ *
+ * @brief Firmware to host clock model implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include "../../include/kobuki_node/firmware_clock.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+// gains of the PI loop that pulls the offset line onto each window's minimum
+const double offset_gain = 0.3;
+const double drift_gain = 0.02;
+// packets in a row that must come late before resyncing (~100ms of stream)
+const unsigned int late_packets_to_resync = 5;
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+FirmwareClock::FirmwareClock(const double &window_length, const double &resync_threshold) :
+  window_length(window_length),
+  resync_threshold(resync_threshold),
+  initialised(false),
+  last_stamp(0),
+  unwrapped_stamp(0),
+  firmware_time(0.0),
+  reference_time(0.0),
+  reference_offset(0.0),
+  drift(0.0),
+  has_window(false),
+  window_start(0.0),
+  window_minimum(0.0),
+  last_delay(0.0),
+  late_packets(0),
+  resync_count(0)
+{}
+
+double FirmwareClock::update(const uint16_t &firmware_stamp, const double &host_time) {
+  if ( !initialised ) {
+    unwrapped_stamp = 0;
+    firmware_time = 0.0;
+    last_stamp = firmware_stamp;
+    drift = 0.0;
+    initialised = true;
+    restart(host_time);
+    last_delay = 0.0;
+    return host_time;
+  }
+
+  // unsigned arithmetic takes care of the wrap around
+  unwrapped_stamp += static_cast<uint16_t>(firmware_stamp - last_stamp);
+  last_stamp = firmware_stamp;
+  firmware_time = static_cast<double>(unwrapped_stamp) * 0.001;
+
+  const double raw_offset = host_time - firmware_time;
+  if ( raw_offset < estimatedOffset(firmware_time) - resync_threshold ) {
+    // arrived long before it should have; the firmware clock jumped (e.g. it rebooted)
+    resync(raw_offset);
+  } else if ( raw_offset > estimatedOffset(firmware_time) + resync_threshold ) {
+    // arrived long after it should have; once it keeps happening the host clock
+    // jumped or the stream stalled for more than a wrap around
+    if ( ++late_packets >= late_packets_to_resync ) {
+      resync(raw_offset);
+    }
+  } else {
+    late_packets = 0;
+  }
+
+  window_minimum = std::min(window_minimum, raw_offset);
+  if ( !has_window ) {
+    // no line yet, just follow the lower envelope
+    reference_time = firmware_time;
+    reference_offset = window_minimum;
+  }
+
+  if ( firmware_time - window_start >= window_length ) {
+    const double error = window_minimum - estimatedOffset(firmware_time);
+    reference_offset = estimatedOffset(firmware_time) + (has_window ? offset_gain * error : error);
+    if ( has_window ) {
+      drift += drift_gain * error / window_length;
+    }
+    reference_time = firmware_time;
+    has_window = true;
+    window_start = firmware_time;
+    window_minimum = raw_offset;
+  }
+
+  const double stamp = firmware_time + estimatedOffset(firmware_time);
+  last_delay = host_time - stamp;
+  return std::min(stamp, host_time); // never stamp into the future
+}
+
+void FirmwareClock::resync(const double &raw_offset) {
+  restart(raw_offset);
+  ++resync_count;
+}
+
+void FirmwareClock::restart(const double &raw_offset) {
+  reference_time = firmware_time;
+  reference_offset = raw_offset;
+  has_window = false;
+  window_start = firmware_time;
+  window_minimum = raw_offset;
+  late_packets = 0;
+}
+
+} // namespace kobuki
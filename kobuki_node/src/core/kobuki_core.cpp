@@ -0,0 +1,290 @@
+/**
+ * @file /src/core/kobuki_core.cpp
+ *
+ * @brief Ros free processing of the kobuki sensor stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_node/kobuki_core.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const double gyro_interval = 0.01;    // the 3d gyro samples at 100Hz [s]
+const double digit_to_dps = 0.00875;  // digit to deg/s ratio, comes from datasheet of 3d gyro[L3G4200D].
+}
+
+/*****************************************************************************
+** Implementation [RawInertiaSamples]
+*****************************************************************************/
+
+const unsigned int RawInertiaSamples::capacity;
+
+/*****************************************************************************
+** Implementation [CoreParameters]
+*****************************************************************************/
+
+CoreParameters::CoreParameters() :
+  use_firmware_clock(true),
+  use_imu_heading(true),
+  command_timeout(0.6),
+  sensor_state_rate(0.0),
+  joint_state_rate(0.0),
+  dock_ir_rate(0.0),
+  inertia_rate(0.0),
+  odometry_rate(0.0),
+  compact_key_frame_interval(50)
+{}
+
+/*****************************************************************************
+** Implementation [KobukiCore]
+*****************************************************************************/
+
+KobukiCore::KobukiCore(const Clock &clock) :
+  clock(clock),
+  replaying(false),
+  command_timeout(clock),
+  hazards_published(false)
+{}
+
+void KobukiCore::init(const CoreParameters &parameters) {
+  config = parameters;
+  command_timeout.configure(config.command_timeout);
+  odometry.useImuHeading(config.use_imu_heading);
+  sensor_state_decimator.init(config.sensor_state_rate);
+  joint_state_decimator.init(config.joint_state_rate);
+  dock_ir_decimator.init(config.dock_ir_rate);
+  inertia_decimator.init(config.inertia_rate);
+  odometry_decimator.init(config.odometry_rate);
+  compact_sensor_encoder = CompactSensorEncoder(std::max(config.compact_key_frame_interval, 1u));
+}
+
+void KobukiCore::reconnected() {
+  firmware_clock.reset();
+  stream_health.restart();
+  odometry.reconnected();
+}
+
+void KobukiCore::replay(const double &start_time, const uint16_t &start_stamp) {
+  replay_clock.start(start_time, start_stamp);
+  replaying = true;
+}
+
+void KobukiCore::capture(Kobuki &kobuki, StreamSnapshot &snapshot) {
+  snapshot.receive_time = clock.now();
+  snapshot.core_sensors = kobuki.getCoreSensorData();
+  snapshot.dock_ir = kobuki.getDockIRData();
+  snapshot.inertia = kobuki.getInertiaData();
+  snapshot.cliff = kobuki.getCliffData();
+  snapshot.current = kobuki.getCurrentData();
+  snapshot.gp_input = kobuki.getGpInputData();
+  snapshot.raw_inertia = kobuki.getRawInertiaData();
+  snapshot.battery = kobuki.batteryStatus();
+
+  // Take latest encoders and gyro data
+  kobuki.updateOdometry(snapshot.pose_update, snapshot.pose_update_rates);
+  kobuki.getWheelJointStates(snapshot.wheel_left_position, snapshot.wheel_left_velocity,    // left wheel
+                             snapshot.wheel_right_position, snapshot.wheel_right_velocity); // right wheel
+  snapshot.heading = kobuki.getHeading();
+  snapshot.angular_velocity = kobuki.getAngularVelocity();
+  stamp(snapshot);
+  integrate(snapshot);
+}
+
+void KobukiCore::stamp(StreamSnapshot &snapshot) {
+  // one stamp shared by every output made from this packet; the clock
+  // model always runs since the stream health reports it
+  const double firmware_stamp = firmware_clock.update(snapshot.core_sensors.time_stamp, snapshot.receive_time);
+  snapshot.stamp = config.use_firmware_clock ? firmware_stamp : snapshot.receive_time;
+  if ( replaying ) {
+    snapshot.stamp = replay_clock.update(snapshot.core_sensors.time_stamp);
+  }
+  stream_health.update(snapshot.core_sensors.time_stamp, snapshot.receive_time, firmware_clock);
+}
+
+void KobukiCore::integrate(StreamSnapshot &snapshot) {
+  snapshot.odometry = odometry.update(snapshot.stamp, snapshot.pose_update, snapshot.pose_update_rates,
+                                      snapshot.heading, snapshot.angular_velocity);
+}
+
+void KobukiCore::processHazards(const StreamSnapshot &snapshot, StreamSink &sink) {
+  const CoreSensors::Data &data = snapshot.core_sensors;
+  uint8_t current = 0;
+  if (data.bumper & CoreSensors::Flags::LeftBumper)   { current |= Hazards::BumperLeft; }
+  if (data.bumper & CoreSensors::Flags::CenterBumper) { current |= Hazards::BumperCenter; }
+  if (data.bumper & CoreSensors::Flags::RightBumper)  { current |= Hazards::BumperRight; }
+  if (data.cliff & CoreSensors::Flags::LeftCliff)     { current |= Hazards::CliffLeft; }
+  if (data.cliff & CoreSensors::Flags::CenterCliff)   { current |= Hazards::CliffCenter; }
+  if (data.cliff & CoreSensors::Flags::RightCliff)    { current |= Hazards::CliffRight; }
+  if (data.wheel_drop & CoreSensors::Flags::LeftWheel)  { current |= Hazards::WheelDropLeft; }
+  if (data.wheel_drop & CoreSensors::Flags::RightWheel) { current |= Hazards::WheelDropRight; }
+
+  if ( hazards_published && (current == hazards.hazards) ) {
+    return;
+  }
+  hazards.stamp = snapshot.stamp;
+  hazards.changed = hazards_published ? (current ^ hazards.hazards) : current;
+  hazards.hazards = current;
+  if ( hazards_published ) {
+    ++hazards.sequence;
+  }
+  hazards.time_stamp = data.time_stamp;
+  hazards_published = true;
+  sink.publishHazardState(hazards);
+}
+
+/**
+ * The outputs below are made for every packet, or if a rate is configured,
+ * once per decimation window with the samples in between aggregated (see
+ * decimation.hpp).
+ */
+void KobukiCore::process(const StreamSnapshot &snapshot, StreamSink &sink) {
+  processWheelState(snapshot, sink);
+  processSensorState(snapshot, sink);
+  processCompactSensorState(snapshot, sink);
+  processDockIR(snapshot, sink);
+  processInertia(snapshot, sink);
+  processRawInertia(snapshot, sink);
+}
+
+void KobukiCore::convertRawInertia(const ThreeAxisGyro::Data &data, const double &stamp, RawInertiaSamples &samples) {
+  const unsigned int length = data.followed_data_length / 3;
+  samples.size = (length < RawInertiaSamples::capacity) ? length : RawInertiaSamples::capacity;
+  samples.frame_id = data.frame_id;
+  samples.packet_stamp = stamp;
+  for ( unsigned int i = 0; i < samples.size; ++i ) {
+    // Update rate of 3d gyro sensor is 100 Hz, but robot's update rate is 50 Hz.
+    // So, here is some compensation.
+    // See also https://github.com/yujinrobot/kobuki/issues/216
+    samples.stamp[i] = stamp - gyro_interval * (length - i - 1);
+
+    // Sensing axis of 3d gyro is not match with robot. It is rotated 90 degree counterclockwise about z-axis.
+    samples.angular_velocity[i][0] = ecl::degrees_to_radians( -digit_to_dps * (short)data.data[i*3+1] );
+    samples.angular_velocity[i][1] = ecl::degrees_to_radians(  digit_to_dps * (short)data.data[i*3+0] );
+    samples.angular_velocity[i][2] = ecl::degrees_to_radians(  digit_to_dps * (short)data.data[i*3+2] );
+  }
+}
+
+/*****************************************************************************
+** Private Implementation
+*****************************************************************************/
+
+void KobukiCore::processWheelState(const StreamSnapshot &snapshot, StreamSink &sink) {
+  // integrated in the driver thread, only delivered to someone listening
+  const OdometryState &state = snapshot.odometry;
+  if ( sink.subscribed(StreamOutput::Transform) ) {
+    sink.publishTransform(state);
+  }
+  if ( !sink.subscribed(StreamOutput::Odometry) ) {
+    odometry_decimator.reset();
+  } else if ( odometry_decimator.update(snapshot.stamp) ) {
+    sink.publishOdometry(state);
+  }
+
+  if ( !sink.subscribed(StreamOutput::JointState) ) {
+    joint_state_decimator.reset();
+  } else if ( joint_state_decimator.update(snapshot.stamp) ) {
+    sink.publishJointState(snapshot);
+  }
+}
+
+void KobukiCore::processSensorState(const StreamSnapshot &snapshot, StreamSink &sink) {
+  if ( !sink.subscribed(StreamOutput::SensorState) ) {
+    sensor_state_decimator.reset();
+    sensor_state_window.reset();
+    return;
+  }
+  sensor_state_window.add(snapshot);
+  if ( sensor_state_decimator.update(snapshot.stamp) ) {
+    sink.publishSensorState(snapshot, sensor_state_window);
+    sensor_state_window.reset();
+  }
+}
+
+/**
+ * Made for every packet while subscribed, not decimated. The first frame
+ * after a subscribe is a key frame, unchanged fields are left out of the
+ * frames in between key frames (see compact_sensors.hpp for the layout).
+ */
+void KobukiCore::processCompactSensorState(const StreamSnapshot &snapshot, StreamSink &sink) {
+  if ( !sink.subscribed(StreamOutput::CompactSensorState) ) {
+    compact_sensor_encoder.requestKeyFrame(); // whoever subscribes next starts with a full frame
+    return;
+  }
+
+  const CoreSensors::Data &data = snapshot.core_sensors;
+  CompactSensorState &state = compact_sensor_state;
+  state.time_stamp = data.time_stamp;
+  state.bumper = data.bumper;
+  state.wheel_drop = data.wheel_drop;
+  state.cliff = data.cliff;
+  state.buttons = data.buttons;
+  state.left_encoder = data.left_encoder;
+  state.right_encoder = data.right_encoder;
+  state.left_pwm = data.left_pwm;
+  state.right_pwm = data.right_pwm;
+  state.charger = data.charger;
+  state.battery = data.battery;
+  state.over_current = data.over_current;
+  for ( unsigned int i = 0; i < 3 && i < snapshot.cliff.bottom.size(); ++i ) {
+    state.bottom[i] = snapshot.cliff.bottom[i];
+  }
+  for ( unsigned int i = 0; i < 2 && i < snapshot.current.current.size(); ++i ) {
+    state.current[i] = snapshot.current.current[i];
+  }
+  state.digital_input = snapshot.gp_input.digital_input;
+  for ( unsigned int i = 0; i < 4 && i < snapshot.gp_input.analog_input.size(); ++i ) {
+    state.analog_input[i] = snapshot.gp_input.analog_input[i];
+  }
+  sink.publishCompactSensorState(compact_frame, compact_sensor_encoder.encode(state, compact_frame));
+}
+
+void KobukiCore::processInertia(const StreamSnapshot &snapshot, StreamSink &sink) {
+  if ( !sink.subscribed(StreamOutput::Inertia) ) {
+    inertia_decimator.reset();
+    inertia_window.reset();
+    return;
+  }
+  inertia_window.add(snapshot);
+  if ( inertia_decimator.update(snapshot.stamp) ) {
+    sink.publishInertia(snapshot, inertia_window);
+    inertia_window.reset();
+  }
+}
+
+void KobukiCore::processRawInertia(const StreamSnapshot &snapshot, StreamSink &sink) {
+  if ( sink.subscribed(StreamOutput::RawInertia) ) {
+    convertRawInertia(snapshot.raw_inertia, snapshot.stamp, raw_inertia_samples);
+    sink.publishRawInertia(raw_inertia_samples);
+  }
+}
+
+void KobukiCore::processDockIR(const StreamSnapshot &snapshot, StreamSink &sink) {
+  if ( !sink.subscribed(StreamOutput::DockIR) ) {
+    dock_ir_decimator.reset();
+    dock_ir_window.reset();
+    return;
+  }
+  dock_ir_window.add(snapshot);
+  if ( dock_ir_decimator.update(snapshot.stamp) ) {
+    sink.publishDockIR(snapshot, dock_ir_window);
+    dock_ir_window.reset();
+  }
+}
+
+} // namespace kobuki
@@ -0,0 +1,52 @@
+/**
+ * @file /src/core/odometry_model.cpp
+ *
+ * @brief Integrates the wheel odometry into a pose.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <ecl/geometry/angle.hpp>
+#include "../../include/kobuki_node/odometry_model.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+const OdometryState& OdometryModel::update(const double &stamp, const ecl::LegacyPose2D<double> &pose_update,
+                                           const ecl::linear_algebra::Vector3d &pose_update_rates,
+                                           const double &imu_heading, const double &imu_angular_velocity) {
+  pose *= pose_update;
+  current.angular_velocity = pose_update_rates[2];
+
+  if ( use_imu_heading ) {
+    if ( heading_resync ) {
+      // carry on from the current heading
+      heading_offset = pose.heading() - imu_heading;
+      heading_resync = false;
+    }
+    // Overwite with gyro heading data
+    pose.heading(ecl::wrap_angle(imu_heading + heading_offset));
+    current.angular_velocity = imu_angular_velocity;
+  }
+
+  current.stamp = stamp;
+  current.x = pose.x();
+  current.y = pose.y();
+  current.heading = pose.heading();
+  current.linear_velocity = pose_update_rates[0];
+  current.lateral_velocity = pose_update_rates[1];
+  return current;
+}
+
+} // namespace kobuki
@@ -0,0 +1,121 @@
+/**
+ * @file /src/core/quantile_estimator.cpp
+ *
+ * @brief P-square quantile estimator implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include "../../include/kobuki_node/quantile_estimator.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+QuantileEstimator::QuantileEstimator(const double &quantile) :
+  p(quantile),
+  samples(0)
+{
+  for ( unsigned int i = 0; i < 5; ++i ) {
+    heights[i] = 0.0;
+    positions[i] = i;
+  }
+  increments[0] = 0.0;
+  increments[1] = p / 2.0;
+  increments[2] = p;
+  increments[3] = (1.0 + p) / 2.0;
+  increments[4] = 1.0;
+  for ( unsigned int i = 0; i < 5; ++i ) {
+    desired[i] = 4.0 * increments[i];
+  }
+}
+
+void QuantileEstimator::add(const double &x) {
+  if ( samples < 5 ) {
+    heights[samples++] = x;
+    if ( samples == 5 ) {
+      std::sort(heights, heights + 5);
+      for ( unsigned int i = 0; i < 5; ++i ) {
+        positions[i] = i;
+        desired[i] = 4.0 * increments[i];
+      }
+    }
+    return;
+  }
+  ++samples;
+
+  // find the cell the sample falls in, stretching the extremes if needed
+  int k;
+  if ( x < heights[0] ) {
+    heights[0] = x;
+    k = 0;
+  } else if ( x >= heights[4] ) {
+    heights[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while ( x >= heights[k + 1] ) {
+      ++k;
+    }
+  }
+  for ( int i = k + 1; i < 5; ++i ) {
+    ++positions[i];
+  }
+  for ( int i = 0; i < 5; ++i ) {
+    desired[i] += increments[i];
+  }
+
+  // nudge the middle markers back towards their desired positions
+  for ( int i = 1; i < 4; ++i ) {
+    const double offset = desired[i] - positions[i];
+    if ( (offset >= 1.0 && positions[i + 1] - positions[i] > 1) ||
+         (offset <= -1.0 && positions[i - 1] - positions[i] < -1) ) {
+      const int d = (offset > 0.0) ? 1 : -1;
+      const double height = parabolic(i, d);
+      if ( heights[i - 1] < height && height < heights[i + 1] ) {
+        heights[i] = height;
+      } else {
+        heights[i] = linear(i, d);
+      }
+      positions[i] += d;
+    }
+  }
+}
+
+double QuantileEstimator::value() const {
+  if ( samples >= 5 ) {
+    return heights[2];
+  }
+  if ( samples == 0 ) {
+    return 0.0;
+  }
+  double sorted[5];
+  std::copy(heights, heights + samples, sorted);
+  std::sort(sorted, sorted + samples);
+  return sorted[static_cast<unsigned long>(p * (samples - 1) + 0.5)];
+}
+
+double QuantileEstimator::parabolic(const int &i, const double &d) const {
+  const double below = static_cast<double>(positions[i] - positions[i - 1]);
+  const double above = static_cast<double>(positions[i + 1] - positions[i]);
+  return heights[i] + d / (positions[i + 1] - positions[i - 1]) *
+      ((below + d) * (heights[i + 1] - heights[i]) / above +
+       (above - d) * (heights[i] - heights[i - 1]) / below);
+}
+
+double QuantileEstimator::linear(const int &i, const int &d) const {
+  return heights[i] + d * (heights[i + d] - heights[i]) / (positions[i + d] - positions[i]);
+}
+
+} // namespace kobuki
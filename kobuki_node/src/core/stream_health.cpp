@@ -0,0 +1,131 @@
+/**
+ * @file /src/core/stream_health.cpp
+ *
+ * @brief Packet loss, jitter and clock statistics of the sensor stream.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include "../../include/kobuki_node/stream_health.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const unsigned int stream_period = 20; // kobuki streams at 50Hz [ms]
+}
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+StreamHealthReport::StreamHealthReport() :
+  status(NoPackets), rate(0.0), packets(0), lost(0), loss(0.0),
+  jitter_median(0.0), jitter_p95(0.0), jitter_p99(0.0), jitter_max(0.0),
+  delay_median(0.0), delay_p99(0.0),
+  clock_offset(0.0), clock_skew(0.0), clock_resyncs(0),
+  total_packets(0), total_lost(0)
+{}
+
+StreamHealth::StreamHealth(const double &loss_threshold, const double &jitter_threshold) :
+  loss_threshold(loss_threshold), jitter_threshold(jitter_threshold),
+  started(false), last_stamp(0), last_receive_time(0.0),
+  packets(0), lost(0), intervals(0), interval_time(0.0),
+  jitter_median(0.5), jitter_p95(0.95), jitter_p99(0.99),
+  delay_median(0.5), delay_p99(0.99), jitter_max(0.0),
+  total_packets(0), total_lost(0),
+  clock_offset(0.0), clock_skew(0.0), clock_resyncs(0)
+{}
+
+void StreamHealth::update(const uint16_t &firmware_stamp, const double &receive_time, const FirmwareClock &clock) {
+  mutex.lock();
+  ++packets;
+  ++total_packets;
+  if ( started ) {
+    // unsigned arithmetic takes care of the wrap around
+    const unsigned int firmware_interval = static_cast<uint16_t>(firmware_stamp - last_stamp);
+    const unsigned int missing = (firmware_interval + stream_period / 2) / stream_period;
+    if ( missing > 1 ) {
+      lost += missing - 1;
+      total_lost += missing - 1;
+    }
+    const double host_interval = receive_time - last_receive_time;
+    ++intervals;
+    interval_time += host_interval;
+    // deviation from the firmware's own spacing, so lost packets don't count as jitter
+    const double jitter = std::fabs(host_interval * 1000.0 - firmware_interval);
+    jitter_median.add(jitter);
+    jitter_p95.add(jitter);
+    jitter_p99.add(jitter);
+    jitter_max = std::max(jitter_max, jitter);
+  }
+  started = true;
+  last_stamp = firmware_stamp;
+  last_receive_time = receive_time;
+
+  if ( clock.isInitialised() ) {
+    delay_median.add(clock.lastDelay() * 1000.0);
+    delay_p99.add(clock.lastDelay() * 1000.0);
+    clock_offset = clock.offset();
+    clock_skew = clock.skew();
+    clock_resyncs = clock.resyncs();
+  }
+  mutex.unlock();
+}
+
+void StreamHealth::report(StreamHealthReport &report) {
+  mutex.lock();
+  report.rate = (interval_time > 0.0) ? intervals / interval_time : 0.0;
+  report.packets = packets;
+  report.lost = lost;
+  report.loss = (packets + lost > 0) ? (100.0 * lost) / (packets + lost) : 0.0;
+  report.jitter_median = jitter_median.value();
+  report.jitter_p95 = jitter_p95.value();
+  report.jitter_p99 = jitter_p99.value();
+  report.jitter_max = jitter_max;
+  report.delay_median = delay_median.value();
+  report.delay_p99 = delay_p99.value();
+  report.clock_offset = clock_offset;
+  report.clock_skew = clock_skew;
+  report.clock_resyncs = clock_resyncs;
+  report.total_packets = total_packets;
+  report.total_lost = total_lost;
+
+  if ( packets == 0 ) {
+    report.status = StreamHealthReport::NoPackets;
+  } else if ( report.loss > loss_threshold ) {
+    report.status = StreamHealthReport::Lossy;
+  } else if ( report.jitter_p99 > jitter_threshold ) {
+    report.status = StreamHealthReport::Jittery;
+  } else {
+    report.status = StreamHealthReport::Healthy;
+  }
+
+  // start a new window
+  packets = 0;
+  lost = 0;
+  intervals = 0;
+  interval_time = 0.0;
+  jitter_median.reset();
+  jitter_p95.reset();
+  jitter_p99.reset();
+  jitter_max = 0.0;
+  delay_median.reset();
+  delay_p99.reset();
+  mutex.unlock();
+}
+
+} // namespace kobuki
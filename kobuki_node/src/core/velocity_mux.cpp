@@ -0,0 +1,88 @@
+/**
+ * @file /kobuki_node/src/core/velocity_mux.cpp
+ *
+ * @brief Velocity command arbitration implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <sstream>
+#include "../../include/kobuki_node/velocity_mux.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+const int VelocityMux::idle;
+
+bool VelocityMux::configure(const std::vector<VelocityMuxInput> &new_inputs) {
+  error_message.clear();
+  for ( unsigned int i = 0; i < new_inputs.size(); ++i ) {
+    if ( new_inputs[i].name.empty() || new_inputs[i].topic.empty() ) {
+      std::ostringstream message;
+      message << "velocity mux input " << i << " needs a name and a topic";
+      error_message = message.str();
+      return false;
+    }
+    for ( unsigned int j = 0; j < i; ++j ) {
+      if ( new_inputs[i].name == new_inputs[j].name ) {
+        error_message = "velocity mux input name '" + new_inputs[i].name + "' is used twice";
+        return false;
+      }
+      if ( new_inputs[i].priority == new_inputs[j].priority ) {
+        std::ostringstream message;
+        message << "velocity mux inputs '" << new_inputs[j].name << "' and '" << new_inputs[i].name
+                << "' have the same priority " << new_inputs[i].priority;
+        error_message = message.str();
+        return false;
+      }
+    }
+  }
+  inputs = new_inputs;
+  last_command.assign(inputs.size(), -1.0);
+  active_input = idle;
+  return true;
+}
+
+bool VelocityMux::commandReceived(const unsigned int &input) {
+  const double now = clock.now();
+  if ( expired(now) ) {
+    active_input = idle;
+  }
+  last_command[input] = now;
+  if ( (active_input == idle) || (active_input == static_cast<int>(input)) ||
+       (inputs[input].priority > inputs[active_input].priority) ) {
+    active_input = static_cast<int>(input);
+    return true;
+  }
+  return false;
+}
+
+bool VelocityMux::update() {
+  if ( !expired(clock.now()) ) {
+    return false;
+  }
+  active_input = idle;
+  return true;
+}
+
+const std::string& VelocityMux::activeName() const {
+  static const std::string idle_name("idle");
+  return (active_input == idle) ? idle_name : inputs[active_input].name;
+}
+
+bool VelocityMux::expired(const double &now) const {
+  return (active_input != idle) && (now - last_command[active_input] > inputs[active_input].timeout);
+}
+
+} // namespace kobuki
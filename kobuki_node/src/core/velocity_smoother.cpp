@@ -0,0 +1,101 @@
+/**
+ * @file /kobuki_node/src/core/velocity_smoother.cpp
+ *
+ * @brief Velocity smoother implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include "../../include/kobuki_node/velocity_smoother.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Constants
+*****************************************************************************/
+
+namespace {
+const double linear_tolerance = 0.2;  // [m/s] from the ramp before following the measured velocity
+const double angular_tolerance = 1.0; // [rad/s]
+const double max_step = 0.1;          // [s] longer gaps in the stream are stepped as this
+}
+
+/*****************************************************************************
+** Implementation [Axis]
+*****************************************************************************/
+
+void VelocitySmoother::Axis::reset(const double &measured) {
+  target = 0.0;
+  velocity = measured;
+  acceleration = 0.0;
+}
+
+void VelocitySmoother::Axis::step(const double &dt, const double &measured) {
+  if ( limits.acceleration <= 0.0 ) {
+    velocity = target;
+    return;
+  }
+  if ( std::fabs(measured - velocity) > tolerance ) {
+    // not following, carry on from where the base is
+    velocity = measured;
+    acceleration = 0.0;
+  }
+  const double error = target - velocity;
+  if ( error == 0.0 ) {
+    acceleration = 0.0;
+    return;
+  }
+  const double direction = (error > 0.0) ? 1.0 : -1.0;
+  double desired = direction * limits.acceleration;
+  if ( limits.jerk > 0.0 ) {
+    // no faster than lets the acceleration ease out to zero right at the target
+    desired = direction * std::min(limits.acceleration, std::sqrt(2.0 * limits.jerk * std::fabs(error)));
+    const double max_change = limits.jerk * dt;
+    acceleration += std::max(-max_change, std::min(desired - acceleration, max_change));
+  } else {
+    acceleration = desired;
+  }
+  velocity += acceleration * dt;
+  if ( (target - velocity) * direction <= 0.0 ) {
+    velocity = target;
+    acceleration = 0.0;
+  }
+}
+
+/*****************************************************************************
+** Implementation [VelocitySmoother]
+*****************************************************************************/
+
+void VelocitySmoother::configure(const SmoothingLimits &linear_limits, const SmoothingLimits &angular_limits) {
+  linear_axis.limits = linear_limits;
+  linear_axis.tolerance = linear_tolerance;
+  angular_axis.limits = angular_limits;
+  angular_axis.tolerance = angular_tolerance;
+  is_enabled = (linear_limits.acceleration > 0.0) || (angular_limits.acceleration > 0.0);
+  reset(0.0, 0.0);
+}
+
+void VelocitySmoother::reset(const double &measured_linear, const double &measured_angular) {
+  linear_axis.reset(measured_linear);
+  angular_axis.reset(measured_angular);
+  last_stamp = -1.0;
+}
+
+void VelocitySmoother::step(const double &stamp, const double &measured_linear, const double &measured_angular) {
+  const double dt = (last_stamp < 0.0) ? 0.0 : std::max(0.0, std::min(stamp - last_stamp, max_step));
+  last_stamp = stamp;
+  linear_axis.step(dt, measured_linear);
+  angular_axis.step(dt, measured_angular);
+}
+
+} // namespace kobuki
@@ -0,0 +1,500 @@
+/**
+ * @file /src/emulator/firmware_emulator.cpp
+ *
+ * @brief Emulates the kobuki firmware on a pseudo terminal.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include "firmware_emulator.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Helpers
+*****************************************************************************/
+
+namespace {
+
+const double bias = 0.23;                // wheel separation [m]
+const double ticks_per_meter = 11724.41; // 2578.33 ticks per revolution, 35mm wheel radius
+const double digit_to_dps = 0.00875;     // 3 axis gyro [deg/s per digit]
+const uint8_t hardware_version[3] = { 4, 0, 1 }; // patch, minor, major
+const uint8_t firmware_version[3] = { 0, 2, 1 };
+
+double monotonicTime() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<double>(now.tv_sec) + static_cast<double>(now.tv_nsec) * 1.0e-9;
+}
+
+int16_t clampToInt16(const double &value) {
+  return static_cast<int16_t>(std::max(-32768.0, std::min(32767.0, value)));
+}
+
+} // namespace
+
+/*****************************************************************************
+** Implementation [EmulatorConfig, EmulatorStatistics]
+*****************************************************************************/
+
+EmulatorConfig::EmulatorConfig() :
+  rate(50.0),
+  inertia_every(1),
+  gyro_every(1),
+  dock_ir_every(1),
+  cliff_every(1),
+  current_every(1),
+  gp_input_every(1),
+  gyro_samples(2),
+  checksum_error_rate(0.0),
+  truncate_rate(0.0),
+  garbage_rate(0.0),
+  stall_period(0.0),
+  stall_duration(0.0),
+  seed(1),
+  verbose(false)
+{}
+
+EmulatorStatistics::EmulatorStatistics() :
+  packets(0), bytes(0), overruns(0),
+  checksum_errors(0), truncations(0), garbage(0), stalls(0),
+  commands(0), bad_commands(0), unknown_commands(0)
+{}
+
+/*****************************************************************************
+** Implementation [FirmwareEmulator]
+*****************************************************************************/
+
+FirmwareEmulator::FirmwareEmulator(const EmulatorConfig &config) :
+  config(config),
+  master(-1),
+  slave(-1),
+  stop_requested(false),
+  sequence(0),
+  time(0.0),
+  random_state(config.seed ? config.seed : 1),
+  parser_state(WaitHeader0),
+  command_length(0),
+  speed(0), radius(0),
+  x(0.0), y(0.0), heading(0.0),
+  left_velocity(0.0), right_velocity(0.0), angular_velocity(0.0),
+  left_ticks(0.0), right_ticks(0.0),
+  gp_output(0),
+  gain_type(0), p_gain(100000), i_gain(100), d_gain(2000), // firmware defaults (x1000)
+  requested_extra(0),
+  controller_info_requested(false),
+  gyro_frame(0)
+{}
+
+FirmwareEmulator::~FirmwareEmulator() {
+  if ( slave >= 0 ) {
+    ::close(slave);
+  }
+  if ( master >= 0 ) {
+    ::close(master);
+  }
+}
+
+bool FirmwareEmulator::open() {
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ( (master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0) ) {
+    error_message = std::string("could not open a pseudo terminal [") + strerror(errno) + "]";
+    return false;
+  }
+  device_port = ptsname(master);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  // held open so the terminal stays raw and the master doesn't hang up
+  // while the node (re)connects
+  slave = ::open(device_port.c_str(), O_RDWR | O_NOCTTY);
+  termios attributes;
+  if ( (slave < 0) || (tcgetattr(slave, &attributes) != 0) ) {
+    error_message = "could not open the pseudo terminal [" + device_port + "][" + strerror(errno) + "]";
+    return false;
+  }
+  cfmakeraw(&attributes);
+  tcsetattr(slave, TCSANOW, &attributes);
+  return true;
+}
+
+void FirmwareEmulator::run() {
+  const double period = 1.0 / config.rate;
+  const double start = monotonicTime();
+  double next_packet = start;
+  double stall_end = 0.0;
+  double next_stall = (config.stall_period > 0.0) ? start + config.stall_period : 0.0;
+  double last_report = start;
+  while ( !stop_requested ) {
+    double now = monotonicTime();
+    const int timeout = std::max(0, static_cast<int>((next_packet - now) * 1000.0));
+    pollfd descriptor = { master, POLLIN, 0 };
+    if ( (poll(&descriptor, 1, timeout) > 0) && (descriptor.revents & POLLIN) ) {
+      readCommands();
+    }
+    now = monotonicTime();
+    if ( now < next_packet ) {
+      continue;
+    }
+    step(now - start - time);
+    time = now - start;
+    if ( (next_stall > 0.0) && (now >= next_stall) ) {
+      stall_end = now + config.stall_duration;
+      next_stall += config.stall_period;
+      ++stats.stalls;
+      if ( config.verbose ) {
+        printf("stalling for %.3fs\n", config.stall_duration);
+      }
+    }
+    if ( now >= stall_end ) {
+      buildPacket();
+      sendPacket();
+    }
+    next_packet += period;
+    if ( next_packet < now - 1.0 ) {
+      next_packet = now; // fell way behind, don't burst to catch up
+    }
+    if ( config.verbose && (now - last_report >= 1.0) ) {
+      printf("packets %lu, overruns %lu, commands %lu (bad %lu), speed %d mm/s, radius %d mm, "
+             "pose [%.3f, %.3f, %.3f]\n", stats.packets, stats.overruns, stats.commands, stats.bad_commands,
+             speed, radius, x, y, heading);
+      fflush(stdout);
+      last_report = now;
+    }
+  }
+}
+
+/*****************************************************************************
+** Implementation [Packets]
+*****************************************************************************/
+
+void FirmwareEmulator::beginPacket() {
+  packet.clear();
+  put8(Protocol::header0);
+  put8(Protocol::header1);
+  put8(0); // length, filled in at the end
+}
+
+void FirmwareEmulator::beginSubPayload(const uint8_t &id, const uint8_t &length) {
+  put8(id);
+  put8(length);
+}
+
+void FirmwareEmulator::put16(const uint16_t &value) {
+  put8(static_cast<uint8_t>(value & 0xff));
+  put8(static_cast<uint8_t>(value >> 8));
+}
+
+void FirmwareEmulator::put32(const uint32_t &value) {
+  put16(static_cast<uint16_t>(value & 0xffff));
+  put16(static_cast<uint16_t>(value >> 16));
+}
+
+void FirmwareEmulator::endPacket() {
+  packet[2] = static_cast<uint8_t>(packet.size() - 3);
+  uint8_t checksum = 0;
+  for ( unsigned int i = 2; i < packet.size(); ++i ) {
+    checksum ^= packet[i];
+  }
+  put8(checksum);
+}
+
+void FirmwareEmulator::buildPacket() {
+  const unsigned long n = sequence++;
+  const double left_speed = left_velocity * 1000.0;   // [mm/s]
+  const double right_speed = right_velocity * 1000.0;
+  beginPacket();
+
+  beginSubPayload(Protocol::CoreSensors, 15);
+  put16(static_cast<uint16_t>(static_cast<uint64_t>(time * 1000.0) & 0xffff));
+  put8(0);   // bumper
+  put8(0);   // wheel drop
+  put8(0);   // cliff
+  put16(static_cast<uint16_t>(static_cast<int64_t>(floor(left_ticks)) & 0xffff));
+  put16(static_cast<uint16_t>(static_cast<int64_t>(floor(right_ticks)) & 0xffff));
+  put8(static_cast<uint8_t>(static_cast<int8_t>(std::max(-100.0, std::min(100.0, left_speed / 7.0)))));
+  put8(static_cast<uint8_t>(static_cast<int8_t>(std::max(-100.0, std::min(100.0, right_speed / 7.0)))));
+  put8(0);   // buttons
+  put8(0);   // charger, discharging
+  put8(160); // battery [0.1V]
+  put8(0);   // over current
+
+  if ( config.dock_ir_every && (n % config.dock_ir_every == 0) ) {
+    beginSubPayload(Protocol::DockInfraRed, 3);
+    put8(0); put8(0); put8(0);
+  }
+  if ( config.inertia_every && (n % config.inertia_every == 0) ) {
+    beginSubPayload(Protocol::Inertia, 7);
+    put16(static_cast<uint16_t>(clampToInt16(heading * 18000.0 / M_PI)));          // [0.01 deg]
+    put16(static_cast<uint16_t>(clampToInt16(angular_velocity * 18000.0 / M_PI))); // [0.01 deg/s]
+    put8(0); put8(0); put8(0);
+  }
+  if ( config.cliff_every && (n % config.cliff_every == 0) ) {
+    beginSubPayload(Protocol::Cliff, 6);
+    put16(2000); put16(2000); put16(2000); // on the floor
+  }
+  if ( config.current_every && (n % config.current_every == 0) ) {
+    beginSubPayload(Protocol::Current, 2);
+    put8(static_cast<uint8_t>(std::min(255.0, 5.0 + fabs(left_speed) / 20.0)));  // [10mA]
+    put8(static_cast<uint8_t>(std::min(255.0, 5.0 + fabs(right_speed) / 20.0)));
+  }
+  if ( config.gyro_every && config.gyro_samples && (n % config.gyro_every == 0) ) {
+    const unsigned int samples = std::min(config.gyro_samples, 8u); // what the driver has room for
+    beginSubPayload(Protocol::ThreeAxisGyro, static_cast<uint8_t>(2 + 6 * samples));
+    put8(gyro_frame++);
+    put8(static_cast<uint8_t>(3 * samples));
+    const int16_t rate = clampToInt16(angular_velocity * 180.0 / M_PI / digit_to_dps);
+    for ( unsigned int i = 0; i < samples; ++i ) {
+      put16(0); put16(0); put16(static_cast<uint16_t>(rate));
+    }
+  }
+  if ( config.gp_input_every && (n % config.gp_input_every == 0) ) {
+    beginSubPayload(Protocol::GpInput, 16);
+    put16(0); // digital input
+    for ( unsigned int i = 0; i < 7; ++i ) {
+      put16(0); // 4 analog inputs, 3 unused
+    }
+  }
+  if ( requested_extra & Protocol::RequestHardwareVersion ) {
+    beginSubPayload(Protocol::HardwareVersion, 4);
+    put8(hardware_version[0]); put8(hardware_version[1]); put8(hardware_version[2]); put8(0);
+  }
+  if ( requested_extra & Protocol::RequestFirmwareVersion ) {
+    beginSubPayload(Protocol::FirmwareVersion, 4);
+    put8(firmware_version[0]); put8(firmware_version[1]); put8(firmware_version[2]); put8(0);
+  }
+  if ( requested_extra & Protocol::RequestUniqueDeviceID ) {
+    beginSubPayload(Protocol::UniqueDeviceID, 12);
+    put32(0x4b4f4255); put32(0x4b49454d); put32(config.seed); // "KOBU" "KIEM" seed
+  }
+  requested_extra = 0;
+  if ( controller_info_requested ) {
+    beginSubPayload(Protocol::ControllerInfo, 13);
+    put8(gain_type);
+    put32(p_gain); put32(i_gain); put32(d_gain);
+    controller_info_requested = false;
+  }
+  endPacket();
+}
+
+void FirmwareEmulator::sendPacket() {
+  if ( random() < config.garbage_rate ) {
+    uint8_t garbage[16];
+    const unsigned int length = 1 + static_cast<unsigned int>(random() * 15.0);
+    for ( unsigned int i = 0; i < length; ++i ) {
+      garbage[i] = static_cast<uint8_t>(random() * 256.0);
+    }
+    if ( ::write(master, garbage, length) > 0 ) {
+      ++stats.garbage;
+    }
+  }
+  size_t length = packet.size();
+  if ( random() < config.checksum_error_rate ) {
+    packet.back() ^= 0xff;
+    ++stats.checksum_errors;
+  }
+  if ( random() < config.truncate_rate ) {
+    length = 1 + static_cast<size_t>(random() * (packet.size() - 1));
+    ++stats.truncations;
+  }
+  const ssize_t result = ::write(master, &packet[0], length);
+  if ( result < 0 ) {
+    ++stats.overruns; // nobody reading and the terminal is full
+    return;
+  }
+  ++stats.packets;
+  stats.bytes += result;
+}
+
+/*****************************************************************************
+** Implementation [Commands]
+*****************************************************************************/
+
+void FirmwareEmulator::readCommands() {
+  uint8_t buffer[256];
+  ssize_t result;
+  while ( (result = ::read(master, buffer, sizeof(buffer))) > 0 ) {
+    for ( ssize_t i = 0; i < result; ++i ) {
+      parseByte(buffer[i]);
+    }
+  }
+}
+
+void FirmwareEmulator::parseByte(const uint8_t &byte) {
+  switch ( parser_state ) {
+    case WaitHeader0: {
+      if ( byte == Protocol::header0 ) {
+        parser_state = WaitHeader1;
+      }
+      break;
+    }
+    case WaitHeader1: {
+      parser_state = (byte == Protocol::header1) ? WaitLength :
+                     (byte == Protocol::header0) ? WaitHeader1 : WaitHeader0;
+      break;
+    }
+    case WaitLength: {
+      command_length = byte;
+      command.clear();
+      parser_state = (command_length > 0) ? WaitPayload : WaitHeader0;
+      break;
+    }
+    case WaitPayload: {
+      command.push_back(byte);
+      if ( command.size() == command_length ) {
+        parser_state = WaitChecksum;
+      }
+      break;
+    }
+    case WaitChecksum: {
+      uint8_t checksum = command_length;
+      for ( unsigned int i = 0; i < command.size(); ++i ) {
+        checksum ^= command[i];
+      }
+      if ( checksum == byte ) {
+        handleCommand(command);
+      } else {
+        ++stats.bad_commands;
+      }
+      parser_state = WaitHeader0;
+      break;
+    }
+    default: {
+      parser_state = WaitHeader0;
+      break;
+    }
+  }
+}
+
+void FirmwareEmulator::handleCommand(const std::vector<uint8_t> &payload) {
+  unsigned int i = 0;
+  while ( i + 2 <= payload.size() ) {
+    const uint8_t id = payload[i];
+    const uint8_t length = payload[i + 1];
+    const uint8_t *data = &payload[0] + i + 2;
+    if ( i + 2 + length > payload.size() ) {
+      ++stats.bad_commands;
+      return;
+    }
+    ++stats.commands;
+    switch ( id ) {
+      case Protocol::BaseControl: {
+        if ( length == 4 ) {
+          speed = static_cast<int16_t>(data[0] | (data[1] << 8));
+          radius = static_cast<int16_t>(data[2] | (data[3] << 8));
+        }
+        break;
+      }
+      case Protocol::Sound: {
+        if ( config.verbose && (length == 3) ) {
+          printf("sound: note %u, duration %u\n", data[0] | (data[1] << 8), data[2]);
+        }
+        break;
+      }
+      case Protocol::SoundSequence: {
+        if ( config.verbose && (length == 1) ) {
+          printf("sound sequence %u\n", data[0]);
+        }
+        break;
+      }
+      case Protocol::RequestExtra: {
+        if ( length == 2 ) {
+          requested_extra |= static_cast<uint16_t>(data[0] | (data[1] << 8));
+        }
+        break;
+      }
+      case Protocol::GpOutput: {
+        if ( length == 2 ) {
+          gp_output = static_cast<uint16_t>(data[0] | (data[1] << 8));
+          if ( config.verbose ) {
+            printf("gp output: digital 0x%x, power 0x%x, leds 0x%x\n",
+                   gp_output & 0x0f, (gp_output >> 4) & 0x0f, (gp_output >> 8) & 0x0f);
+          }
+        }
+        break;
+      }
+      case Protocol::SetControllerGain: {
+        if ( length == 13 ) {
+          gain_type = data[0];
+          p_gain = data[1] | (data[2] << 8) | (data[3] << 16) | (static_cast<uint32_t>(data[4]) << 24);
+          i_gain = data[5] | (data[6] << 8) | (data[7] << 16) | (static_cast<uint32_t>(data[8]) << 24);
+          d_gain = data[9] | (data[10] << 8) | (data[11] << 16) | (static_cast<uint32_t>(data[12]) << 24);
+          if ( config.verbose ) {
+            printf("controller gains: type %u, p %u, i %u, d %u\n", gain_type, p_gain, i_gain, d_gain);
+          }
+        }
+        break;
+      }
+      case Protocol::GetControllerGain: {
+        controller_info_requested = true;
+        break;
+      }
+      default: {
+        ++stats.unknown_commands;
+        break;
+      }
+    }
+    i += 2 + length;
+  }
+}
+
+/*****************************************************************************
+** Implementation [Model]
+*****************************************************************************/
+
+/**
+ * Inverts the driver's speed/radius encoding of the base control command:
+ * a radius of 0 drives straight, 1 turns on the spot (speed is then the
+ * wheel speed) and otherwise speed is that of the outer wheel.
+ */
+void FirmwareEmulator::step(const double &dt) {
+  const double v = static_cast<double>(speed) * 0.001;
+  const double r = static_cast<double>(radius) * 0.001;
+  if ( radius == 0 ) {
+    left_velocity = right_velocity = v;
+  } else if ( radius == 1 ) {
+    left_velocity = -v;
+    right_velocity = v;
+  } else {
+    const double w = v / (r + ((r > 0.0) ? bias / 2.0 : -bias / 2.0));
+    left_velocity = w * (r - bias / 2.0);
+    right_velocity = w * (r + bias / 2.0);
+  }
+  const double linear_velocity = (left_velocity + right_velocity) / 2.0;
+  angular_velocity = (right_velocity - left_velocity) / bias;
+  x += linear_velocity * cos(heading) * dt;
+  y += linear_velocity * sin(heading) * dt;
+  heading = atan2(sin(heading + angular_velocity * dt), cos(heading + angular_velocity * dt));
+  left_ticks += left_velocity * dt * ticks_per_meter;
+  right_ticks += right_velocity * dt * ticks_per_meter;
+}
+
+/**
+ * Xorshift, so fault injection replays the same way for the same seed.
+ */
+double FirmwareEmulator::random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return static_cast<double>(random_state) / 4294967296.0;
+}
+
+} // namespace kobuki
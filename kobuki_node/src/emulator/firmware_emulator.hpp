@@ -0,0 +1,205 @@
+/**
+ * @file /kobuki_node/src/emulator/firmware_emulator.hpp
+ *
+ * @brief Emulates the kobuki firmware on a pseudo terminal.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+** Ifdefs
+*****************************************************************************/
+
+#ifndef KOBUKI_NODE_FIRMWARE_EMULATOR_HPP_
+#define KOBUKI_NODE_FIRMWARE_EMULATOR_HPP_
+
+/*****************************************************************************
+** Includes
+*****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Protocol
+*****************************************************************************/
+
+/**
+ * @brief The parts of the serial protocol the emulator speaks.
+ *
+ * @code
+ * packet      : 0xAA 0x55, length, length bytes of sub-payloads, checksum
+ * sub-payload : id, length, length bytes of data
+ * checksum    : xor of the length and all the sub-payload bytes
+ * @endcode
+ *
+ * All multi-byte values are little endian.
+ */
+namespace Protocol {
+enum Feedback {
+  CoreSensors = 1,      // 15 bytes
+  Inertia = 4,          // 7 bytes
+  Cliff = 5,            // 6 bytes
+  Current = 6,          // 2 bytes
+  DockInfraRed = 7,     // 3 bytes
+  HardwareVersion = 10, // 4 bytes
+  FirmwareVersion = 11, // 4 bytes
+  ThreeAxisGyro = 13,   // 2 + 6n bytes
+  GpInput = 16,         // 16 bytes
+  UniqueDeviceID = 19,  // 12 bytes
+  ControllerInfo = 21   // 13 bytes
+};
+enum Command {
+  BaseControl = 1,       // 4 bytes
+  Sound = 3,             // 3 bytes
+  SoundSequence = 4,     // 1 byte
+  RequestExtra = 9,      // 2 bytes
+  GpOutput = 12,         // 2 bytes
+  SetControllerGain = 13, // 13 bytes
+  GetControllerGain = 14  // 1 byte
+};
+enum RequestExtraFlags {
+  RequestHardwareVersion = 0x01,
+  RequestFirmwareVersion = 0x02,
+  RequestUniqueDeviceID = 0x08
+};
+const uint8_t header0 = 0xAA;
+const uint8_t header1 = 0x55;
+} // namespace Protocol
+
+/*****************************************************************************
+** Interfaces
+*****************************************************************************/
+
+/**
+ * @brief Emulator settings.
+ */
+struct EmulatorConfig {
+  EmulatorConfig();
+
+  double rate;                 // stream packets per second
+  // the optional sub-payloads go into every n-th packet, 0 for never
+  unsigned int inertia_every, gyro_every, dock_ir_every, cliff_every, current_every, gp_input_every;
+  unsigned int gyro_samples;   // 3 axis gyro samples per sub-payload
+  // faults, probabilities per packet
+  double checksum_error_rate;  // corrupt the checksum
+  double truncate_rate;        // cut the packet short
+  double garbage_rate;         // write random bytes before the packet
+  // stalls, the stream stops for stall_duration every stall_period [s], 0 for never
+  double stall_period, stall_duration;
+  unsigned int seed;
+  bool verbose;
+};
+
+/**
+ * @brief Emulator statistics.
+ */
+struct EmulatorStatistics {
+  EmulatorStatistics();
+
+  unsigned long packets, bytes, overruns;
+  unsigned long checksum_errors, truncations, garbage, stalls; // injected
+  unsigned long commands, bad_commands, unknown_commands;      // received
+};
+
+/**
+ * @brief Speaks the kobuki serial protocol on a pseudo terminal.
+ *
+ * Streams feedback packets at the configured rate, parses the commands that
+ * come back and drives a simple differential drive model from the base
+ * control commands, so the encoders and the gyro move like the real thing.
+ * Packets that don't fit in the terminal (nobody reading) are dropped and
+ * counted as overruns, as on the real serial line.
+ */
+class FirmwareEmulator {
+public:
+  FirmwareEmulator(const EmulatorConfig &config);
+  ~FirmwareEmulator();
+
+  /**
+   * @brief Open the pseudo terminal.
+   *
+   * @return bool : false if it failed, see error().
+   */
+  bool open();
+
+  /**
+   * @brief Stream and serve commands until stop().
+   */
+  void run();
+  void stop() { stop_requested = true; }
+
+  const std::string& devicePort() const { return device_port; }
+  const EmulatorStatistics& statistics() const { return stats; }
+  const std::string& error() const { return error_message; }
+
+private:
+  /*********************
+   ** Packets
+   **********************/
+  void beginPacket();
+  void beginSubPayload(const uint8_t &id, const uint8_t &length);
+  void put8(const uint8_t &value) { packet.push_back(value); }
+  void put16(const uint16_t &value);
+  void put32(const uint32_t &value);
+  void endPacket();
+  void buildPacket();
+  void sendPacket();
+
+  /*********************
+   ** Commands
+   **********************/
+  void readCommands();
+  void parseByte(const uint8_t &byte);
+  void handleCommand(const std::vector<uint8_t> &payload);
+
+  /*********************
+   ** Model
+   **********************/
+  void step(const double &dt);
+  double random();
+
+  EmulatorConfig config;
+  EmulatorStatistics stats;
+  int master, slave;
+  std::string device_port;
+  volatile bool stop_requested;
+  std::string error_message;
+
+  std::vector<uint8_t> packet;
+  unsigned long sequence;
+  double time;        // since start [s]
+  uint32_t random_state;
+
+  // command parser
+  enum ParserState { WaitHeader0, WaitHeader1, WaitLength, WaitPayload, WaitChecksum };
+  ParserState parser_state;
+  std::vector<uint8_t> command;
+  uint8_t command_length;
+
+  // differential drive
+  int16_t speed, radius;          // last base control command [mm/s], [mm]
+  double x, y, heading;           // [m], [rad]
+  double left_velocity, right_velocity, angular_velocity; // [m/s], [rad/s]
+  double left_ticks, right_ticks;
+
+  // state the commands set or request
+  uint16_t gp_output;
+  uint8_t gain_type;
+  uint32_t p_gain, i_gain, d_gain;
+  uint16_t requested_extra;
+  bool controller_info_requested;
+  uint8_t gyro_frame;
+};
+
+} // namespace kobuki
+
+#endif /* KOBUKI_NODE_FIRMWARE_EMULATOR_HPP_ */
@@ -0,0 +1,155 @@
+/**
+ * @file /src/emulator/kobuki_emulator.cpp
+ *
+ * @brief Kobuki firmware emulator for testing without hardware.
+ *
+ * Point the node's device_port at the printed pseudo terminal (or the
+ * --link symlink) to run it end to end against the emulated base.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "firmware_emulator.hpp"
+
+/*****************************************************************************
+** Globals
+*****************************************************************************/
+
+namespace {
+
+kobuki::FirmwareEmulator *emulator = NULL;
+
+void signalHandler(int /* signal */) {
+  if ( emulator != NULL ) {
+    emulator->stop();
+  }
+}
+
+void usage() {
+  printf("Usage: kobuki_emulator [options]\n"
+         "\n"
+         "Emulates a kobuki on a pseudo terminal.\n"
+         "\n"
+         "Options:\n"
+         "  --rate HZ              stream packets per second (default: 50)\n"
+         "  --inertia N            inertia in every n-th packet, 0 for never (default: 1)\n"
+         "  --gyro N               3 axis gyro in every n-th packet (default: 1)\n"
+         "  --gyro-samples N       3 axis gyro samples per packet, up to 8 (default: 2)\n"
+         "  --dock-ir N            dock ir in every n-th packet (default: 1)\n"
+         "  --cliff N              cliff sensors in every n-th packet (default: 1)\n"
+         "  --current N            motor current in every n-th packet (default: 1)\n"
+         "  --gp-input N           gp input in every n-th packet (default: 1)\n"
+         "  --checksum-errors P    probability of a corrupt checksum (default: 0)\n"
+         "  --truncate P           probability of a truncated packet (default: 0)\n"
+         "  --garbage P            probability of garbage before a packet (default: 0)\n"
+         "  --stall-period S       stall the stream every S seconds, 0 for never (default: 0)\n"
+         "  --stall-duration S     length of the stalls (default: 0)\n"
+         "  --seed N               seed for the fault injection (default: 1)\n"
+         "  --link PATH            symlink PATH to the pseudo terminal (e.g. /tmp/kobuki)\n"
+         "  --verbose              print the commands and a status line every second\n"
+         "  --help                 this message\n");
+}
+
+} // namespace
+
+/*****************************************************************************
+** Main
+*****************************************************************************/
+
+int main(int argc, char **argv) {
+  enum Option {
+    Rate = 256, Inertia, Gyro, GyroSamples, DockIR, Cliff, Current, GpInput,
+    ChecksumErrors, Truncate, Garbage, StallPeriod, StallDuration, Seed, Link, Verbose, Help
+  };
+  const option options[] = {
+    { "rate", required_argument, NULL, Rate },
+    { "inertia", required_argument, NULL, Inertia },
+    { "gyro", required_argument, NULL, Gyro },
+    { "gyro-samples", required_argument, NULL, GyroSamples },
+    { "dock-ir", required_argument, NULL, DockIR },
+    { "cliff", required_argument, NULL, Cliff },
+    { "current", required_argument, NULL, Current },
+    { "gp-input", required_argument, NULL, GpInput },
+    { "checksum-errors", required_argument, NULL, ChecksumErrors },
+    { "truncate", required_argument, NULL, Truncate },
+    { "garbage", required_argument, NULL, Garbage },
+    { "stall-period", required_argument, NULL, StallPeriod },
+    { "stall-duration", required_argument, NULL, StallDuration },
+    { "seed", required_argument, NULL, Seed },
+    { "link", required_argument, NULL, Link },
+    { "verbose", no_argument, NULL, Verbose },
+    { "help", no_argument, NULL, Help },
+    { NULL, 0, NULL, 0 }
+  };
+
+  kobuki::EmulatorConfig config;
+  std::string link;
+  int option;
+  while ( (option = getopt_long(argc, argv, "", options, NULL)) != -1 ) {
+    switch ( option ) {
+      case Rate:           config.rate = atof(optarg); break;
+      case Inertia:        config.inertia_every = atoi(optarg); break;
+      case Gyro:           config.gyro_every = atoi(optarg); break;
+      case GyroSamples:    config.gyro_samples = atoi(optarg); break;
+      case DockIR:         config.dock_ir_every = atoi(optarg); break;
+      case Cliff:          config.cliff_every = atoi(optarg); break;
+      case Current:        config.current_every = atoi(optarg); break;
+      case GpInput:        config.gp_input_every = atoi(optarg); break;
+      case ChecksumErrors: config.checksum_error_rate = atof(optarg); break;
+      case Truncate:       config.truncate_rate = atof(optarg); break;
+      case Garbage:        config.garbage_rate = atof(optarg); break;
+      case StallPeriod:    config.stall_period = atof(optarg); break;
+      case StallDuration:  config.stall_duration = atof(optarg); break;
+      case Seed:           config.seed = atoi(optarg); break;
+      case Link:           link = optarg; break;
+      case Verbose:        config.verbose = true; break;
+      case Help:           usage(); return 0;
+      default:             usage(); return 1;
+    }
+  }
+  if ( config.rate <= 0.0 ) {
+    fprintf(stderr, "The rate must be positive.\n");
+    return 1;
+  }
+
+  kobuki::FirmwareEmulator firmware(config);
+  if ( !firmware.open() ) {
+    fprintf(stderr, "Could not start the emulator: %s\n", firmware.error().c_str());
+    return 1;
+  }
+  if ( !link.empty() ) {
+    unlink(link.c_str());
+    if ( symlink(firmware.devicePort().c_str(), link.c_str()) != 0 ) {
+      fprintf(stderr, "Could not link %s to %s.\n", link.c_str(), firmware.devicePort().c_str());
+      return 1;
+    }
+  }
+  printf("%s\n", firmware.devicePort().c_str());
+  fflush(stdout);
+
+  emulator = &firmware;
+  signal(SIGINT, signalHandler);
+  signal(SIGTERM, signalHandler);
+  firmware.run();
+  emulator = NULL;
+
+  if ( !link.empty() ) {
+    unlink(link.c_str());
+  }
+  const kobuki::EmulatorStatistics &stats = firmware.statistics();
+  printf("sent %lu packets (%lu bytes), %lu overruns\n", stats.packets, stats.bytes, stats.overruns);
+  printf("injected %lu checksum errors, %lu truncations, %lu garbage bursts, %lu stalls\n",
+         stats.checksum_errors, stats.truncations, stats.garbage, stats.stalls);
+  printf("received %lu commands, %lu bad, %lu unknown\n", stats.commands, stats.bad_commands, stats.unknown_commands);
+  return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file /src/library/connection_state.cpp
+ *
+ * @brief Reconnection book keeping implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "../../include/kobuki_node/connection_state.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation [ConnectionState]
+*****************************************************************************/
+
+ConnectionState::ConnectionState(const double &initial_backoff, const double &max_backoff) :
+  initial_backoff(initial_backoff),
+  max_backoff(max_backoff),
+  backoff(initial_backoff),
+  is_connected(false),
+  last_alive(0.0),
+  down_since(0.0),
+  next_attempt(0.0),
+  last_downtime(0.0),
+  total_downtime(0.0),
+  connections(0),
+  failed_attempts(0)
+{}
+
+void ConnectionState::configure(const double &new_initial_backoff, const double &new_max_backoff) {
+  initial_backoff = new_initial_backoff;
+  max_backoff = std::max(new_initial_backoff, new_max_backoff);
+  backoff = initial_backoff;
+}
+
+void ConnectionState::connected(const double &now) {
+  if ( connections > 0 ) {
+    last_downtime = now - down_since;
+    total_downtime += last_downtime;
+  }
+  ++connections;
+  is_connected = true;
+  last_alive = now;
+  backoff = initial_backoff;
+}
+
+void ConnectionState::disconnected(const double &now) {
+  is_connected = false;
+  down_since = now;
+  next_attempt = now;
+  backoff = initial_backoff;
+}
+
+void ConnectionState::attemptFailed(const double &now) {
+  ++failed_attempts;
+  next_attempt = now + backoff;
+  backoff = std::min(2.0 * backoff, max_backoff);
+}
+
+/*****************************************************************************
+** Implementation [Functions]
+*****************************************************************************/
+
+bool resolveDevicePort(const std::string &port, std::string &resolved) {
+  char path[PATH_MAX];
+  if ( realpath(port.c_str(), path) == NULL ) {
+    return false;
+  }
+  resolved = path;
+  return true;
+}
+
+} // namespace kobuki
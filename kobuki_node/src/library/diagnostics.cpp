@@ -10,6 +10,7 @@
  ** Includes
  *****************************************************************************/
 
+#include <algorithm>
 #include "../../include/kobuki_node/diagnostics.hpp"
 
 /*****************************************************************************
@@ -161,4 +162,162 @@ void AnalogInputTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
                 values[0], values[1], values[2], values[3]);
 }
 
+void PublishQueueTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( !threaded ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Publishing from the driver thread");
+    return;
+  }
+
+  if ( dropped > last_dropped ) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Dropped %lu packets, publishing can't keep up",
+                  dropped - last_dropped);
+  } else if ( depth == capacity ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Queue full");
+  } else {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "All right");
+  }
+  last_dropped = dropped;
+
+  stat.addf("Depth", "%u", depth);
+  stat.addf("Capacity", "%u", capacity);
+  stat.addf("Dropped", "%lu", dropped);
+}
+
+void StreamHealthTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  health.report(report);
+  switch ( report.status ) {
+    case ( StreamHealthReport::NoPackets ) : {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::ERROR, "No packets received");
+      break;
+    }
+    case ( StreamHealthReport::Lossy ) : {
+      stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Lost %.1f%% of the packets", report.loss);
+      break;
+    }
+    case ( StreamHealthReport::Jittery ) : {
+      stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "High jitter (%.1f ms)", report.jitter_p99);
+      break;
+    }
+    default : {
+      stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "All right");
+      break;
+    }
+  }
+
+  stat.addf("Rate (Hz)", "%.1f", report.rate);
+  stat.addf("Packets", "%lu", report.packets);
+  stat.addf("Lost", "%lu", report.lost);
+  stat.addf("Loss (%)", "%.2f", report.loss);
+  stat.addf("Jitter p50 (ms)", "%.2f", report.jitter_median);
+  stat.addf("Jitter p95 (ms)", "%.2f", report.jitter_p95);
+  stat.addf("Jitter p99 (ms)", "%.2f", report.jitter_p99);
+  stat.addf("Jitter max (ms)", "%.2f", report.jitter_max);
+  stat.addf("Delay p50 (ms)", "%.2f", report.delay_median);
+  stat.addf("Delay p99 (ms)", "%.2f", report.delay_p99);
+  stat.addf("Clock Offset (s)", "%.6f", report.clock_offset);
+  stat.addf("Clock Skew (ppm)", "%.1f", report.clock_skew * 1.0e6);
+  stat.addf("Clock Resyncs", "%u", report.clock_resyncs);
+  stat.addf("Total Packets", "%lu", report.total_packets);
+  stat.addf("Total Lost", "%lu", report.total_lost);
+}
+
+void CommandLatencyTask::update(const CommandLatencyTracer &tracer) {
+  for ( unsigned int i = 0; i < CommandLatencyTracer::NumberOfStages; ++i ) {
+    stages[i] = tracer.histogram(static_cast<CommandLatencyTracer::Stage>(i)).summary();
+  }
+  commands = tracer.commands();
+  dropped = tracer.dropped();
+  motion_timeouts = tracer.motionTimeouts();
+}
+
+void CommandLatencyTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  const LatencyHistogram::Summary &motion = stages[CommandLatencyTracer::Motion];
+  if ( dropped > last_dropped ) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Dropped %lu traces, driver thread can't keep up",
+                  dropped - last_dropped);
+  } else if ( motion.count == 0 ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "No motion measured yet");
+  } else {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Command to motion p99 %.1f ms", motion.p99 * 1000.0);
+  }
+  last_dropped = dropped;
+
+  for ( unsigned int i = 0; i < CommandLatencyTracer::NumberOfStages; ++i ) {
+    const std::string stage(CommandLatencyTracer::stageName(static_cast<CommandLatencyTracer::Stage>(i)));
+    const LatencyHistogram::Summary &summary = stages[i];
+    stat.addf(stage + " Count", "%lu", summary.count);
+    stat.addf(stage + " p50 (ms)", "%.2f", summary.p50 * 1000.0);
+    stat.addf(stage + " p99 (ms)", "%.2f", summary.p99 * 1000.0);
+    stat.addf(stage + " max (ms)", "%.2f", summary.max * 1000.0);
+  }
+  stat.addf("Commands", "%lu", commands);
+  stat.addf("Dropped", "%lu", dropped);
+  stat.addf("Motion Timeouts", "%lu", motion_timeouts);
+}
+
+void CommandAgeTask::update(const CommandAgeFilter &filter) {
+  ages = filter.histogram().summary();
+  maximum_age = filter.maximumAge();
+  stale = filter.staleCount();
+}
+
+void CommandAgeTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( stale > last_stale ) {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::WARN, "Dropped %lu stale velocity commands",
+                  stale - last_stale);
+  } else if ( ages.count == 0 ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "No stamped velocity commands yet");
+  } else {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::OK, "Command age p99 %.1f ms", ages.p99 * 1000.0);
+  }
+  last_stale = stale;
+
+  stat.addf("Count", "%lu", ages.count);
+  stat.addf("p50 (ms)", "%.2f", ages.p50 * 1000.0);
+  stat.addf("p90 (ms)", "%.2f", ages.p90 * 1000.0);
+  stat.addf("p99 (ms)", "%.2f", ages.p99 * 1000.0);
+  stat.addf("max (ms)", "%.2f", ages.max * 1000.0);
+  stat.addf("Maximum Age (ms)", "%.0f", maximum_age * 1000.0);
+  stat.addf("Stale", "%lu", stale);
+}
+
+void SchedulingTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( !configured ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Normal scheduling");
+  } else if ( succeeded ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "All right");
+  } else {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::WARN, "Some settings could not be applied");
+  }
+  for ( unsigned int i = 0; i < outcomes.size(); ++i ) {
+    stat.add(outcomes[i].first, outcomes[i].second);
+  }
+}
+
+void ConnectionTask::run(diagnostic_updater::DiagnosticStatusWrapper &stat) {
+  if ( connected ) {
+    stat.summary(diagnostic_msgs::DiagnosticStatus::OK, "Connected");
+  } else {
+    stat.summaryf(diagnostic_msgs::DiagnosticStatus::ERROR, "Disconnected for %.1f s, next attempt in %.1f s",
+                  downtime, std::max(next_attempt, 0.0));
+  }
+
+  stat.add("Device", port);
+  stat.addf("Reconnects", "%u", reconnects);
+  stat.addf("Failed Attempts", "%u", failed_attempts);
+  stat.addf("Downtime (s)", "%.1f", downtime);
+  stat.addf("Last Downtime (s)", "%.1f", last_downtime);
+  stat.addf("Total Downtime (s)", "%.1f", total_downtime);
+  if ( time_to_stream >= 0.0 ) {
+    stat.addf("Time To First Packet (s)", "%.3f", time_to_stream);
+  } else {
+    stat.add("Time To First Packet (s)", "waiting");
+  }
+  if ( time_to_version >= 0.0 ) {
+    stat.addf("Time To Version Info (s)", "%.3f", time_to_version);
+  } else {
+    stat.add("Time To Version Info (s)", "waiting");
+  }
+}
+
 } // namespace kobuki
@@ -36,7 +36,9 @@
  ** Includes
  *****************************************************************************/
 
+#include <algorithm>
 #include <float.h>
+#include <boost/bind.hpp>
 #include <tf/tf.h>
 #include <ecl/streams/string_stream.hpp>
 #include <kobuki_msgs/VersionInfo.h>
@@ -49,6 +51,75 @@
 namespace kobuki
 {
 
+/*****************************************************************************
+ ** Helpers
+ *****************************************************************************/
+
+namespace
+{
+
+/**
+ * @brief Queued once, applies the scheduling from whichever thread services the queue.
+ */
+class ThreadSchedulingCallback : public ros::CallbackInterface
+{
+public:
+  ThreadSchedulingCallback(ThreadScheduling &scheduling, const std::string &thread_name) :
+    scheduling(scheduling), thread_name(thread_name) {}
+
+  CallResult call()
+  {
+    scheduling.apply(thread_name);
+    return Success;
+  }
+
+private:
+  ThreadScheduling &scheduling;
+  const std::string thread_name;
+};
+
+/**
+ * @brief A number from the parameter server, which may have come in as an int.
+ */
+bool readNumber(XmlRpc::XmlRpcValue &value, double &number)
+{
+  if (value.getType() == XmlRpc::XmlRpcValue::TypeInt)
+  {
+    number = static_cast<int>(value);
+    return true;
+  }
+  if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+  {
+    number = static_cast<double>(value);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * @brief One entry of the cmd_vel_mux subscribers list.
+ */
+bool readVelocityMuxInput(XmlRpc::XmlRpcValue &value, VelocityMuxInput &input)
+{
+  if ((value.getType() != XmlRpc::XmlRpcValue::TypeStruct) ||
+      !value.hasMember("name") || !value.hasMember("topic") ||
+      !value.hasMember("timeout") || !value.hasMember("priority") ||
+      (value["name"].getType() != XmlRpc::XmlRpcValue::TypeString) ||
+      (value["topic"].getType() != XmlRpc::XmlRpcValue::TypeString) ||
+      (value["priority"].getType() != XmlRpc::XmlRpcValue::TypeInt) ||
+      (static_cast<int>(value["priority"]) < 0) ||
+      !readNumber(value["timeout"], input.timeout))
+  {
+    return false;
+  }
+  input.name = static_cast<std::string>(value["name"]);
+  input.topic = static_cast<std::string>(value["topic"]);
+  input.priority = static_cast<int>(value["priority"]);
+  return true;
+}
+
+} // namespace
+
 /*****************************************************************************
  ** Implementation [KobukiRos]
  *****************************************************************************/
@@ -59,7 +130,12 @@ namespace kobuki
  * Make sure you call the init() method to fully define this node.
  */
 KobukiRos::KobukiRos(std::string& node_name) :
-    name(node_name), cmd_vel_timed_out_(false), serial_timed_out_(false),
+    name(node_name), stream_timeout(5.0), motors_enabled(true),
+    core(clock), serial_timed_out_(false), driver_thread_configured(false),
+    record_raw(false), raw_firmware_stamp(0), replaying(false), replay_finished(false),
+    publish_threaded(false), shutdown_requested(false),
+    command_spinner(1, &command_queue),
+    velocity_mux(clock),
     slot_version_info(&KobukiRos::publishVersionInfo, *this),
     slot_controller_info(&KobukiRos::publishControllerInfo, *this),
     slot_stream_data(&KobukiRos::processStreamData, *this),
@@ -77,7 +153,8 @@ KobukiRos::KobukiRos(std::string& node_name) :
     slot_named(&KobukiRos::rosNamed, *this),
     slot_raw_data_command(&KobukiRos::publishRawDataCommand, *this),
     slot_raw_data_stream(&KobukiRos::publishRawDataStream, *this),
-    slot_raw_control_command(&KobukiRos::publishRawControlCommand, *this)
+    slot_raw_control_command(&KobukiRos::publishRawControlCommand, *this),
+    stream_diagnostics(core.streamHealth())
 {
   updater.setHardwareID("Kobuki");
   updater.add(battery_diagnostics);
@@ -90,6 +167,12 @@ KobukiRos::KobukiRos(std::string& node_name) :
   updater.add(gyro_diagnostics);
   updater.add(dinput_diagnostics);
   updater.add(ainput_diagnostics);
+  updater.add(queue_diagnostics);
+  updater.add(stream_diagnostics);
+  updater.add(latency_diagnostics);
+  updater.add(age_diagnostics);
+  updater.add(scheduling_diagnostics);
+  updater.add(connection_diagnostics);
 }
 
 /**
@@ -98,14 +181,51 @@ KobukiRos::KobukiRos(std::string& node_name) :
  */
 KobukiRos::~KobukiRos()
 {
+  command_spinner.stop();
+  velocity_command_subscriber.shutdown();
+  velocity_stamped_command_subscriber.shutdown();
+  for ( unsigned int i = 0; i < velocity_mux_subscribers.size(); ++i )
+  {
+    velocity_mux_subscribers[i].shutdown();
+  }
+  motor_power_subscriber.shutdown();
   ROS_INFO_STREAM("Kobuki : waiting for kobuki thread to finish [" << name << "].");
+  disconnect();
+  if ( record_raw )
+  {
+    boost::mutex::scoped_lock lock(raw_recorder_mutex);
+    ROS_INFO_STREAM("Kobuki : raw recorder wrote " << raw_recorder.records() << " packets, dropped "
+                    << raw_recorder.dropped() << " [" << name << "].");
+    raw_recorder.close();
+  }
+  if ( replaying )
+  {
+    raw_replay.stop();
+    replay_thread.join();
+  }
+  if ( publish_threaded )
+  {
+    ROS_INFO_STREAM("Kobuki : waiting for publishing thread to finish [" << name << "].");
+    {
+      boost::mutex::scoped_lock lock(publish_mutex);
+      shutdown_requested.store(true, boost::memory_order_release);
+    }
+    publish_condition.notify_one();
+    publish_thread.join();
+  }
 }
 
 bool KobukiRos::init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub)
 {
+  const ros::WallTime init_start = ros::WallTime::now();
+
   /*********************
    ** Communications
    **********************/
+  if (!configureVelocityMux(nh))
+  {
+    return false;
+  }
   advertiseTopics(nh);
   subscribeTopics(nh);
 
@@ -134,8 +254,6 @@ bool KobukiRos::init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub)
   /*********************
    ** Driver Parameters
    **********************/
-  Parameters parameters;
-
   nh.param("acceleration_limiter", parameters.enable_acceleration_limiter, false);
   nh.param("battery_capacity", parameters.battery_capacity, Battery::capacity);
   nh.param("battery_low", parameters.battery_low, Battery::low);
@@ -148,6 +266,31 @@ bool KobukiRos::init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub)
     return false;
   }
 
+  /*********************
+   ** Replay
+   **********************/
+  std::string replay_directory;
+  nh.param("replay/directory", replay_directory, std::string(""));
+  if ( !replay_directory.empty() )
+  {
+    double replay_speed;
+    bool replay_loop;
+    nh.param("replay/speed", replay_speed, 1.0);
+    nh.param("replay/loop", replay_loop, false);
+    if ( !raw_replay.open(replay_directory, std::max(replay_speed, 0.0), replay_loop) )
+    {
+      ROS_ERROR_STREAM("Kobuki : could not replay " << replay_directory << ", " << raw_replay.error() << " [" << name << "].");
+      return false;
+    }
+    // the driver reads the replayed stream like any other serial device
+    parameters.device_port = raw_replay.devicePort();
+    core.replay(static_cast<double>(raw_replay.startTime()) * 1.0e-9, raw_replay.startStamp());
+    replaying = true;
+    replay_thread.start(&RawReplay::run, raw_replay);
+    ROS_INFO_STREAM("Kobuki : replaying " << replay_directory << " at "
+                    << (replay_speed > 0.0 ? replay_speed : 0.0) << "x (0 for as fast as possible) [" << name << "].");
+  }
+
   /*********************
    ** Joint States
    **********************/
@@ -177,6 +320,105 @@ bool KobukiRos::init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub)
   joint_states.velocity.resize(2,0.0);
   joint_states.effort.resize(2,0.0);
 
+  initMessagePools();
+
+  /*********************
+   ** Time Stamps
+   **********************/
+  CoreParameters core_parameters;
+  nh.param("use_firmware_clock", core_parameters.use_firmware_clock, true);
+  if (core_parameters.use_firmware_clock)
+  {
+    ROS_INFO_STREAM("Kobuki : stamping stream data with the firmware clock [" << name << "].");
+  }
+
+  /*********************
+   ** Publishing Rates
+   **********************/
+  nh.param("publish_rate/sensors_core", core_parameters.sensor_state_rate, 0.0);
+  nh.param("publish_rate/joint_states", core_parameters.joint_state_rate, 0.0);
+  nh.param("publish_rate/dock_ir", core_parameters.dock_ir_rate, 0.0);
+  nh.param("publish_rate/imu_data", core_parameters.inertia_rate, 0.0);
+
+  int key_frame_interval;
+  nh.param("compact_key_frame_interval", key_frame_interval, 50);
+  core_parameters.compact_key_frame_interval = std::max(key_frame_interval, 1);
+
+  nh.param("cmd_vel_timeout", core_parameters.command_timeout, 0.6);
+  ROS_INFO_STREAM("Kobuki : Velocity commands timeout: " << core_parameters.command_timeout << " seconds [" << name << "].");
+
+  double cmd_vel_max_age;
+  nh.param("cmd_vel_max_age", cmd_vel_max_age, 0.2);
+  command_age.configure(std::max(cmd_vel_max_age, 0.0));
+
+  /*********************
+   ** Velocity Smoother
+   **********************/
+  SmoothingLimits linear_limits, angular_limits;
+  nh.param("velocity_smoother/linear/acceleration", linear_limits.acceleration, 0.0);
+  nh.param("velocity_smoother/linear/jerk", linear_limits.jerk, 0.0);
+  nh.param("velocity_smoother/angular/acceleration", angular_limits.acceleration, 0.0);
+  nh.param("velocity_smoother/angular/jerk", angular_limits.jerk, 0.0);
+  velocity_smoother.configure(linear_limits, angular_limits);
+  if (velocity_smoother.enabled())
+  {
+    ROS_INFO_STREAM("Kobuki : smoothing velocity commands, linear " << linear_limits.acceleration << "m/s^2, "
+                    << linear_limits.jerk << "m/s^3, angular " << angular_limits.acceleration << "rad/s^2, "
+                    << angular_limits.jerk << "rad/s^3 (0 for unlimited) [" << name << "].");
+  }
+
+  /*********************
+   ** Scheduling
+   **********************/
+  // applied by each thread as it starts, so configure before any of them does
+  int rt_priority;
+  std::string rt_policy;
+  std::vector<int> cpu_affinity;
+  bool lock_memory;
+  nh.param("rt_priority", rt_priority, 0);
+  nh.param("rt_policy", rt_policy, std::string("fifo"));
+  XmlRpc::XmlRpcValue cpus;
+  if (nh.getParam("cpu_affinity", cpus) && (cpus.getType() == XmlRpc::XmlRpcValue::TypeArray))
+  {
+    for (int i = 0; i < cpus.size(); ++i)
+    {
+      if (cpus[i].getType() == XmlRpc::XmlRpcValue::TypeInt)
+      {
+        cpu_affinity.push_back(static_cast<int>(cpus[i]));
+      }
+    }
+  }
+  nh.param("lock_memory", lock_memory, false);
+  if (!thread_scheduling.init(rt_priority, rt_policy, cpu_affinity, lock_memory))
+  {
+    ROS_WARN_STREAM("Kobuki : " << thread_scheduling.error() << ", keeping normal scheduling [" << name << "].");
+  }
+  else if (thread_scheduling.configured())
+  {
+    thread_scheduling.lockMemory();
+    ROS_INFO_STREAM("Kobuki : applying real time scheduling (priority " << rt_priority << ", policy "
+                    << rt_policy << ") to our threads [" << name << "].");
+  }
+
+  /*********************
+   ** Publishing Thread
+   **********************/
+  int publish_queue_size;
+  nh.param("publish_queue_size", publish_queue_size, 8);
+  if (publish_queue_size > 0)
+  {
+    // serialisation and publishing happen in our own thread, the driver thread only queues snapshots
+    publish_queue.init(publish_queue_size);
+    publish_threaded = true;
+    publish_thread.start(&KobukiRos::publishLoop, *this);
+    ROS_INFO_STREAM("Kobuki : publishing stream data from a separate thread, queue size "
+                    << publish_queue_size << " [" << name << "].");
+  }
+  else
+  {
+    ROS_INFO_STREAM("Kobuki : publishing stream data from the driver thread [" << name << "].");
+  }
+
   /*********************
    ** Validation
    **********************/
@@ -201,39 +443,76 @@ bool KobukiRos::init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub)
   }
 
   odometry.init(nh, name);
+  core_parameters.use_imu_heading = odometry.useImuHeading();
+  core_parameters.odometry_rate = odometry.publishRate();
+  core.init(core_parameters);
 
   /*********************
-   ** Driver Init
+   ** Raw Recording
    **********************/
-  try
+  std::string raw_directory;
+  nh.param("raw_recorder/directory", raw_directory, std::string(""));
+  if ( !raw_directory.empty() )
   {
-    kobuki.init(parameters);
-    ros::Duration(0.25).sleep(); // wait for some data to come in.
-    if ( !kobuki.isAlive() ) {
-      ROS_WARN_STREAM("Kobuki : no data stream, is kobuki turned on?");
-      // don't need to return false here - simply turning kobuki on while spin()'ing should resurrect the situation.
+    int segment_size, segments;
+    nh.param("raw_recorder/segment_size", segment_size, 4 * 1024 * 1024);
+    nh.param("raw_recorder/segments", segments, 8);
+    if ( raw_recorder.open(raw_directory, std::max(segment_size, 0), std::max(segments, 0)) )
+    {
+      record_raw = true;
+      ROS_INFO_STREAM("Kobuki : recording the raw serial traffic to " << raw_directory << " ("
+                      << segments << " segments of " << segment_size << " bytes) [" << name << "].");
+    }
+    else
+    {
+      ROS_ERROR_STREAM("Kobuki : could not start the raw recorder, " << raw_recorder.error() << " [" << name << "].");
     }
-    kobuki.enable();
   }
-  catch (const ecl::StandardException &e)
+
+  /*********************
+   ** Reconnection
+   **********************/
+  double initial_backoff, max_backoff;
+  nh.param("reconnect/initial_backoff", initial_backoff, 0.5);
+  nh.param("reconnect/max_backoff", max_backoff, 30.0);
+  nh.param("reconnect/stream_timeout", stream_timeout, 5.0);
+  connection.configure(initial_backoff, max_backoff);
+
+  double startup_timeout;
+  nh.param("startup_timeout", startup_timeout, 2.0);
+
+  /*********************
+   ** Driver Init
+   **********************/
+  if ( connect() )
   {
-    switch (e.flag())
-    {
-      case (ecl::OpenError):
-      {
-        ROS_ERROR_STREAM("Kobuki : could not open connection [" << parameters.device_port << "][" << name << "].");
-        break;
-      }
-      default:
-      {
-        ROS_ERROR_STREAM("Kobuki : initialisation failed [" << name << "].");
-        ROS_DEBUG_STREAM(e.what());
-        break;
+    connection.connected(ros::WallTime::now().toSec());
+    // woken by the first stream and version info packets
+    if ( !startup.waitUntilReady(startup_timeout) ) {
+      if ( !startup.streamReady() ) {
+        ROS_WARN_STREAM("Kobuki : no data stream after " << startup_timeout << "s, is kobuki turned on?");
+      } else {
+        ROS_WARN_STREAM("Kobuki : no version info after " << startup_timeout << "s [" << name << "].");
       }
+      // don't need to return false here - simply turning kobuki on while spin()'ing should resurrect the situation.
     }
-    return false;
+    ROS_INFO_STREAM("Kobuki : startup took " << (ros::WallTime::now() - init_start).toSec()
+                    << "s, first packet " << startup.timeToStream()
+                    << "s and version info " << startup.timeToVersion()
+                    << "s after opening the port [" << name << "].");
+  }
+  else
+  {
+    // no need to restart, the update loop keeps trying
+    ROS_WARN_STREAM("Kobuki : will keep trying to connect in the background [" << name << "].");
+    connection.disconnected(ros::WallTime::now().toSec());
+    connection.attemptFailed(ros::WallTime::now().toSec());
   }
-  // kobuki.printSigSlotConnections();
+  // kobuki->printSigSlotConnections();
+
+  // only now the driver is up, start servicing the motion commands
+  command_queue.addCallback(ros::CallbackInterfacePtr(new ThreadSchedulingCallback(thread_scheduling, "Commands")));
+  command_spinner.start();
   return true;
 }
 /**
@@ -243,31 +522,22 @@ bool KobukiRos::init(ros::NodeHandle& nh, ros::NodeHandle& nh_pub)
  *
  * Note that the actual driver data is collected via the slot callbacks in this class.
  *
- * @return Bool : true/false if successfully updated or not (kobuki driver shutdown).
+ * @return Bool : true/false if successfully updated or not.
  */
 bool KobukiRos::update()
 {
-  if ( kobuki.isShutdown() )
+  if ( replaying && !replay_finished && raw_replay.finished() )
   {
-    ROS_ERROR_STREAM("Kobuki : Driver has been shutdown. Stopping update loop. [" << name << "].");
-    return false;
+    ROS_INFO_STREAM("Kobuki : replay finished after " << raw_replay.packets() << " packets and "
+                    << raw_replay.loops() << " loops [" << name << "].");
+    replay_finished = true; // a dead stream from here on is expected
   }
-
-  if ( (kobuki.isEnabled() == true) && odometry.commandTimeout())
+  if ( !replay_finished )
   {
-    if ( !cmd_vel_timed_out_ )
-    {
-      kobuki.setBaseControl(0, 0);
-      cmd_vel_timed_out_ = true;
-      ROS_WARN("Kobuki : Incoming velocity commands not received for more than %.2f seconds -> zero'ing velocity commands", odometry.timeout().toSec());
-    }
-  }
-  else
-  {
-    cmd_vel_timed_out_ = false;
+    updateConnection();
   }
 
-  bool is_alive = kobuki.isAlive();
+  bool is_alive = kobuki && kobuki->isAlive();
   if ( watchdog_diagnostics.isAlive() && !is_alive )
   {
     if ( !serial_timed_out_ )
@@ -281,21 +551,162 @@ bool KobukiRos::update()
     }
   }
 
+  // all sensor diagnostics come from the same stream packet
+  stream_snapshots.read(diagnostics_snapshot);
+
   watchdog_diagnostics.update(is_alive);
-  battery_diagnostics.update(kobuki.batteryStatus());
-  cliff_diagnostics.update(kobuki.getCoreSensorData().cliff, kobuki.getCliffData());
-  bumper_diagnostics.update(kobuki.getCoreSensorData().bumper);
-  wheel_diagnostics.update(kobuki.getCoreSensorData().wheel_drop);
-  motor_diagnostics.update(kobuki.getCurrentData().current);
-  state_diagnostics.update(kobuki.isEnabled());
-  gyro_diagnostics.update(kobuki.getInertiaData().angle);
-  dinput_diagnostics.update(kobuki.getGpInputData().digital_input);
-  ainput_diagnostics.update(kobuki.getGpInputData().analog_input);
+  battery_diagnostics.update(diagnostics_snapshot.battery);
+  cliff_diagnostics.update(diagnostics_snapshot.core_sensors.cliff, diagnostics_snapshot.cliff);
+  bumper_diagnostics.update(diagnostics_snapshot.core_sensors.bumper);
+  wheel_diagnostics.update(diagnostics_snapshot.core_sensors.wheel_drop);
+  motor_diagnostics.update(diagnostics_snapshot.current.current);
+  state_diagnostics.update(kobuki && kobuki->isEnabled());
+  gyro_diagnostics.update(diagnostics_snapshot.inertia.angle);
+  dinput_diagnostics.update(diagnostics_snapshot.gp_input.digital_input);
+  ainput_diagnostics.update(diagnostics_snapshot.gp_input.analog_input);
+  queue_diagnostics.update(publish_threaded, publish_queue.size(), publish_queue.capacity(),
+                           publish_queue.droppedCount());
+  latency_diagnostics.update(command_latency);
+  age_diagnostics.update(command_age);
+  scheduling_diagnostics.update(thread_scheduling);
+  connection_diagnostics.update(connection, startup, ros::WallTime::now().toSec(), device_port);
   updater.update();
 
+  if ( (ros::WallTime::now() - last_command_latency_report).toSec() >= 1.0 )
+  {
+    publishCommandLatency();
+    last_command_latency_report = ros::WallTime::now();
+  }
+
   return true;
 }
 
+/**
+ * @brief Create and start a new driver on the (re-resolved) device port.
+ *
+ * Publishers, subscribers and the odometry pose are ours and carry on, the
+ * driver's slots connect to the new driver by name.
+ *
+ * @return bool : false if the port doesn't exist or couldn't be opened.
+ */
+bool KobukiRos::connect()
+{
+  Parameters driver_parameters(parameters);
+  if ( !parameters.simulation && !resolveDevicePort(parameters.device_port, driver_parameters.device_port) )
+  {
+    ROS_ERROR_STREAM("Kobuki : device port doesn't exist [" << parameters.device_port << "][" << name << "].");
+    return false;
+  }
+
+  boost::unique_lock<boost::shared_mutex> lock(driver_mutex);
+  kobuki.reset(new KobukiDriver);
+  startup.start(ros::WallTime::now().toSec());
+  try
+  {
+    kobuki->init(driver_parameters);
+  }
+  catch (const ecl::StandardException &e)
+  {
+    switch (e.flag())
+    {
+      case (ecl::OpenError):
+      {
+        ROS_ERROR_STREAM("Kobuki : could not open connection [" << driver_parameters.device_port << "][" << name << "].");
+        break;
+      }
+      default:
+      {
+        ROS_ERROR_STREAM("Kobuki : initialisation failed [" << name << "].");
+        ROS_DEBUG_STREAM(e.what());
+        break;
+      }
+    }
+    kobuki.reset();
+    return false;
+  }
+  if ( driver_parameters.device_port != parameters.device_port )
+  {
+    ROS_INFO_STREAM("Kobuki : " << parameters.device_port << " resolved to "
+                    << driver_parameters.device_port << " [" << name << "].");
+  }
+  device_port = driver_parameters.device_port;
+
+  // a new driver thread, a new odometry and maybe a rebooted firmware; the
+  // driver thread can't touch these while we hold the lock
+  driver_thread_configured = false;
+  core.reconnected();
+  {
+    boost::mutex::scoped_lock base_control_lock(base_control_mutex);
+    if ( motors_enabled )
+    {
+      kobuki->enable();
+    }
+    core.commandTimeout().commandReceived();
+  }
+  return true;
+}
+
+/**
+ * @brief Stop and destroy the driver.
+ *
+ * Its thread may be in one of our slots, those bail out while the lock is
+ * held exclusively, so it is safe to wait for it here.
+ */
+void KobukiRos::disconnect()
+{
+  boost::unique_lock<boost::shared_mutex> lock(driver_mutex);
+  kobuki.reset();
+}
+
+/**
+ * @brief Reconnection state machine, stepped by the update loop.
+ *
+ * The connection is declared lost when the driver shuts down or the stream
+ * stays dead for stream_timeout. Attempts then follow with exponential
+ * backoff until one succeeds.
+ */
+void KobukiRos::updateConnection()
+{
+  const double now = ros::WallTime::now().toSec();
+  if ( connection.isConnected() )
+  {
+    if ( kobuki->isAlive() )
+    {
+      connection.alive(now);
+      return;
+    }
+    if ( kobuki->isShutdown() )
+    {
+      ROS_ERROR_STREAM("Kobuki : Driver has been shutdown, reconnecting [" << name << "].");
+    }
+    else if ( (stream_timeout > 0.0) && (connection.silence(now) > stream_timeout) )
+    {
+      ROS_ERROR_STREAM("Kobuki : no data stream for " << stream_timeout << "s, reconnecting [" << name << "].");
+    }
+    else
+    {
+      return;
+    }
+    disconnect();
+    connection.disconnected(now);
+  }
+
+  if ( connection.attemptDue(now) )
+  {
+    if ( connect() )
+    {
+      connection.connected(ros::WallTime::now().toSec());
+      ROS_INFO_STREAM("Kobuki : reconnected after " << connection.lastDowntime() << "s [" << name << "].");
+    }
+    else
+    {
+      connection.attemptFailed(ros::WallTime::now().toSec());
+      ROS_WARN_STREAM("Kobuki : reconnection failed, next attempt in "
+                      << connection.nextAttempt(ros::WallTime::now().toSec()) << "s [" << name << "].");
+    }
+  }
+}
+
 /**
  * Two groups of publishers, one required by turtlebot, the other for
  * kobuki esoterics.
@@ -305,7 +716,7 @@ void KobukiRos::advertiseTopics(ros::NodeHandle& nh)
   /*********************
   ** Turtlebot Required
   **********************/
-  joint_state_publisher = nh.advertise <sensor_msgs::JointState>("joint_states",100);
+  joint_state_publisher.advertise<sensor_msgs::JointState>(nh, "joint_states", 100);
 
   /*********************
   ** Kobuki Esoterics
@@ -319,13 +730,180 @@ void KobukiRos::advertiseTopics(ros::NodeHandle& nh)
   power_event_publisher  = nh.advertise < kobuki_msgs::PowerSystemEvent > ("events/power_system", 100);
   input_event_publisher  = nh.advertise < kobuki_msgs::DigitalInputEvent > ("events/digital_input", 100);
   robot_event_publisher  = nh.advertise < kobuki_msgs::RobotStateEvent > ("events/robot_state", 100, true); // also latched
-  sensor_state_publisher = nh.advertise < kobuki_msgs::SensorState > ("sensors/core", 100);
-  dock_ir_publisher = nh.advertise < kobuki_msgs::DockInfraRed > ("sensors/dock_ir", 100);
-  imu_data_publisher = nh.advertise < sensor_msgs::Imu > ("sensors/imu_data", 100);
-  raw_imu_data_publisher = nh.advertise < sensor_msgs::Imu > ("sensors/imu_data_raw", 100);
+  hazard_state_publisher = nh.advertise < kobuki_node::HazardState > ("events/hazards", 100, true); // also latched
+  sensor_state_publisher.advertise<kobuki_msgs::SensorState>(nh, "sensors/core", 100);
+  compact_sensor_publisher.advertise<std_msgs::UInt8MultiArray>(nh, "sensors/core_compact", 100);
+  dock_ir_publisher.advertise<kobuki_msgs::DockInfraRed>(nh, "sensors/dock_ir", 100);
+  imu_data_publisher.advertise<sensor_msgs::Imu>(nh, "sensors/imu_data", 100);
+  raw_imu_data_publisher.advertise<sensor_msgs::Imu>(nh, "sensors/imu_data_raw", 100);
+  raw_gyro_batch_publisher.advertise<kobuki_node::RawGyroBatch>(nh, "sensors/imu_data_raw_batch", 100);
   raw_data_command_publisher = nh.advertise< std_msgs::String > ("debug/raw_data_command", 100);
   raw_data_stream_publisher = nh.advertise< std_msgs::String > ("debug/raw_data_stream", 100);
   raw_control_command_publisher = nh.advertise< std_msgs::Int16MultiArray > ("debug/raw_control_command", 100);
+  command_latency_publisher.advertise<kobuki_node::CommandLatency>(nh, "debug/command_latency", 100);
+  if (velocity_mux.configured())
+  {
+    velocity_mux_active_publisher = nh.advertise< std_msgs::String > ("cmd_vel_mux/active", 1, true); // latched
+    publishActiveVelocityInput(VelocityMux::idle);
+  }
+}
+
+/**
+ * @brief Reads the prioritized velocity inputs, if there are any.
+ *
+ * Same schema as the cmd_vel_mux nodelet's configuration, loaded into our
+ * cmd_vel_mux namespace (e.g. rosparam load of param/cmd_vel_mux_minimal.yaml
+ * with ns="cmd_vel_mux").
+ *
+ * @return bool : false if they are there, but invalid.
+ */
+bool KobukiRos::configureVelocityMux(ros::NodeHandle& nh)
+{
+  XmlRpc::XmlRpcValue subscribers;
+  if (!nh.getParam("cmd_vel_mux/subscribers", subscribers))
+  {
+    return true; // plain commands/velocity
+  }
+  std::vector<VelocityMuxInput> inputs;
+  if (subscribers.getType() == XmlRpc::XmlRpcValue::TypeArray)
+  {
+    for (int i = 0; i < subscribers.size(); ++i)
+    {
+      VelocityMuxInput input;
+      if (!readVelocityMuxInput(subscribers[i], input))
+      {
+        ROS_ERROR_STREAM("Kobuki : cmd_vel_mux subscriber " << i
+                         << " needs a name, topic, timeout and priority [" << name << "].");
+        return false;
+      }
+      inputs.push_back(input);
+    }
+  }
+  if (inputs.empty())
+  {
+    ROS_ERROR_STREAM("Kobuki : cmd_vel_mux/subscribers should be a list of velocity inputs [" << name << "].");
+    return false;
+  }
+  if (!velocity_mux.configure(inputs))
+  {
+    ROS_ERROR_STREAM("Kobuki : " << velocity_mux.error() << " [" << name << "].");
+    return false;
+  }
+  // prebuilt, switching inputs is on the command path
+  for (unsigned int i = 0; i <= velocity_mux.size(); ++i)
+  {
+    velocity_mux_active_names.push_back(std_msgs::StringPtr(new std_msgs::String));
+    velocity_mux_active_names.back()->data = (i < velocity_mux.size()) ? velocity_mux.input(i).name : "idle";
+  }
+  for (unsigned int i = 0; i < velocity_mux.size(); ++i)
+  {
+    ROS_INFO_STREAM("Kobuki : velocity input '" << velocity_mux.input(i).name << "' on cmd_vel_mux/"
+                    << velocity_mux.input(i).topic << ", priority " << velocity_mux.input(i).priority
+                    << ", timeout " << velocity_mux.input(i).timeout << "s [" << name << "].");
+  }
+  return true;
+}
+
+/**
+ * Call with the base_control_mutex held (or before any thread runs), so the
+ * driver thread's timeouts and the command thread's switches go out in the
+ * order they happened and the latched topic never ends on a stale input.
+ */
+void KobukiRos::publishActiveVelocityInput(const int &input)
+{
+  const unsigned int index = (input == VelocityMux::idle) ? velocity_mux.size() : static_cast<unsigned int>(input);
+  velocity_mux_active_publisher.publish(velocity_mux_active_names[index]);
+}
+
+/**
+ * Publish the velocity command latency histograms, once a second is plenty
+ * since they accumulate from startup.
+ */
+void KobukiRos::publishCommandLatency()
+{
+  if ( !command_latency_publisher.hasSubscribers() )
+  {
+    return;
+  }
+  kobuki_node::CommandLatencyPtr msg(new kobuki_node::CommandLatency);
+  msg->header.stamp = ros::Time::now();
+  msg->commands = command_latency.commands();
+  msg->dropped = command_latency.dropped();
+  msg->motion_timeouts = command_latency.motionTimeouts();
+  msg->stages.resize(CommandLatencyTracer::NumberOfStages);
+  std::vector<uint32_t> counts(LatencyHistogram::number_of_buckets);
+  for ( unsigned int i = 0; i < CommandLatencyTracer::NumberOfStages; ++i )
+  {
+    const CommandLatencyTracer::Stage stage = static_cast<CommandLatencyTracer::Stage>(i);
+    const LatencyHistogram &histogram = command_latency.histogram(stage);
+    kobuki_node::LatencyHistogram &stage_msg = msg->stages[i];
+    const unsigned long total = histogram.read(&counts[0]);
+    stage_msg.stage = CommandLatencyTracer::stageName(stage);
+    stage_msg.count = total;
+    stage_msg.max = histogram.max();
+    stage_msg.p50 = std::min(LatencyHistogram::quantile(&counts[0], total, 0.5), stage_msg.max);
+    stage_msg.p90 = std::min(LatencyHistogram::quantile(&counts[0], total, 0.9), stage_msg.max);
+    stage_msg.p99 = std::min(LatencyHistogram::quantile(&counts[0], total, 0.99), stage_msg.max);
+    for ( unsigned int bucket = 0; bucket < counts.size(); ++bucket )
+    {
+      if ( counts[bucket] > 0 )
+      {
+        stage_msg.bucket_values.push_back(LatencyHistogram::bucketValue(bucket));
+        stage_msg.bucket_counts.push_back(counts[bucket]);
+      }
+    }
+  }
+  command_latency_publisher.publish(msg);
+}
+
+/**
+ * Pre-build the messages recycled by the stream rate publishers, filling in
+ * everything that stays constant from cycle to cycle.
+ */
+void KobukiRos::initMessagePools()
+{
+  kobuki_msgs::SensorState sensor_state;
+  sensor_state.bottom.resize(3, 0);
+  sensor_state.current.resize(2, 0);
+  sensor_state.analog_input.resize(4, 0);
+  sensor_state_pool.init(sensor_state);
+
+  joint_state_pool.init(joint_states);
+
+  kobuki_msgs::DockInfraRed dock_ir;
+  dock_ir.header.frame_id = "dock_ir_link";
+  dock_ir.data.resize(3, 0);
+  dock_ir_pool.init(dock_ir);
+
+  sensor_msgs::Imu imu;
+  imu.header.frame_id = "gyro_link";
+  // set a non-zero covariance on unused dimensions (pitch and roll); this is a requirement of robot_pose_ekf
+  // set yaw covariance as very low, to make it dominate over the odometry heading when combined
+  // 1: fill once, as its always the same;  2: using an invented value; cannot we get a realistic estimation?
+  imu.orientation_covariance[0] = DBL_MAX;
+  imu.orientation_covariance[4] = DBL_MAX;
+  imu.orientation_covariance[8] = 0.05;
+  // angular velocity covariance; useless by now, but robot_pose_ekf's
+  // roadmap claims that it will compute velocities in the future
+  imu.angular_velocity_covariance[0] = DBL_MAX;
+  imu.angular_velocity_covariance[4] = DBL_MAX;
+  imu.angular_velocity_covariance[8] = 0.05;
+  imu_data_pool.init(imu);
+
+  std_msgs::UInt8MultiArray compact_sensors;
+  compact_sensors.data.resize(CompactSensorFormat::max_frame_size, 0); // shrinking later keeps the capacity
+  compact_sensor_pool.init(compact_sensors);
+
+  sensor_msgs::Imu raw_imu;
+  raw_imu.header.frame_id = "gyro_link";
+  // one message per sample, so room for a few packets' worth
+  raw_imu_data_pool.init(raw_imu, 4 * RawInertiaSamples::capacity);
+
+  kobuki_node::RawGyroBatch raw_gyro_batch;
+  raw_gyro_batch.header.frame_id = "gyro_link";
+  raw_gyro_batch_pool.init(raw_gyro_batch);
+
+  hazard_state_pool.init(kobuki_node::HazardState()); // the latched publisher holds on to the last one
 }
 
 /**
@@ -334,14 +912,31 @@ void KobukiRos::advertiseTopics(ros::NodeHandle& nh)
  */
 void KobukiRos::subscribeTopics(ros::NodeHandle& nh)
 {
-  velocity_command_subscriber = nh.subscribe(std::string("commands/velocity"), 10, &KobukiRos::subscribeVelocityCommand, this);
+  ros::NodeHandle command_nh(nh);
+  command_nh.setCallbackQueue(&command_queue);
+  if (velocity_mux.configured())
+  {
+    // input topics relative to cmd_vel_mux, the same names as with the mux nodelet
+    ros::NodeHandle mux_nh(command_nh, "cmd_vel_mux");
+    for (unsigned int i = 0; i < velocity_mux.size(); ++i)
+    {
+      velocity_mux_subscribers.push_back(mux_nh.subscribe<geometry_msgs::Twist>(
+          velocity_mux.input(i).topic, 10, boost::bind(&KobukiRos::subscribeMuxVelocityCommand, this, _1, i)));
+    }
+  }
+  else
+  {
+    velocity_command_subscriber = command_nh.subscribe(std::string("commands/velocity"), 10, &KobukiRos::subscribeVelocityCommand, this);
+    velocity_stamped_command_subscriber = command_nh.subscribe(std::string("commands/velocity_stamped"), 10, &KobukiRos::subscribeVelocityStampedCommand, this);
+  }
+  motor_power_subscriber = command_nh.subscribe("commands/motor_power", 10, &KobukiRos::subscribeMotorPower, this);
+
   led1_command_subscriber =  nh.subscribe(std::string("commands/led1"), 10, &KobukiRos::subscribeLed1Command, this);
   led2_command_subscriber =  nh.subscribe(std::string("commands/led2"), 10, &KobukiRos::subscribeLed2Command, this);
   digital_output_command_subscriber =  nh.subscribe(std::string("commands/digital_output"), 10, &KobukiRos::subscribeDigitalOutputCommand, this);
   external_power_command_subscriber =  nh.subscribe(std::string("commands/external_power"), 10, &KobukiRos::subscribeExternalPowerCommand, this);
   sound_command_subscriber =  nh.subscribe(std::string("commands/sound"), 10, &KobukiRos::subscribeSoundCommand, this);
   reset_odometry_subscriber = nh.subscribe("commands/reset_odometry", 10, &KobukiRos::subscribeResetOdometry, this);
-  motor_power_subscriber = nh.subscribe("commands/motor_power", 10, &KobukiRos::subscribeMotorPower, this);
   controller_info_command_subscriber =  nh.subscribe(std::string("commands/controller_info"), 10, &KobukiRos::subscribeControllerInfoCommand, this);
 }
 
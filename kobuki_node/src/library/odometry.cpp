@@ -26,16 +26,12 @@ namespace kobuki {
 Odometry::Odometry () :
   odom_frame("odom"),
   base_frame("base_footprint"),
+  publish_tf(true),
   use_imu_heading(true),
-  publish_tf(true)
+  odom_rate(0.0)
 {};
 
 void Odometry::init(ros::NodeHandle& nh, const std::string& name) {
-  double timeout;
-  nh.param("cmd_vel_timeout", timeout, 0.6);
-  cmd_vel_timeout.fromSec(timeout);
-  ROS_INFO_STREAM("Kobuki : Velocity commands timeout: " << cmd_vel_timeout << " seconds [" << name << "].");
-
   if (!nh.getParam("odom_frame", odom_frame)) {
     ROS_WARN_STREAM("Kobuki : no param server setting for odom_frame, using default [" << odom_frame << "][" << name << "].");
   } else {
@@ -68,90 +64,75 @@ void Odometry::init(ros::NodeHandle& nh, const std::string& name) {
     }
   }
 
-  odom_trans.header.frame_id = odom_frame;
-  odom_trans.child_frame_id = base_frame;
-
-  pose.setIdentity();
-
-  odom_publisher = nh.advertise<nav_msgs::Odometry>("odom", 50); // topic name and queue size
-}
-
-bool Odometry::commandTimeout() const {
-  if ( (!last_cmd_time.isZero()) && ((ros::Time::now() - last_cmd_time) > cmd_vel_timeout) ) {
-    return true;
-  } else {
-    return false;
-  }
-}
+  tf2_msgs::TFMessage odom_tf;
+  odom_tf.transforms.resize(1);
+  odom_tf.transforms[0].header.frame_id = odom_frame;
+  odom_tf.transforms[0].child_frame_id = base_frame;
+  tf_pool.init(odom_tf);
 
-void Odometry::update(const ecl::LegacyPose2D<double> &pose_update, ecl::linear_algebra::Vector3d &pose_update_rates,
-                      double imu_heading, double imu_angular_velocity) {
-  pose *= pose_update;
+  // Frames and covariances never change, so fill them once in the pooled messages
+  nav_msgs::Odometry odom;
+  odom.header.frame_id = odom_frame;
+  odom.child_frame_id = base_frame;
 
-  if (use_imu_heading == true) {
-    // Overwite with gyro heading data
-    pose.heading(imu_heading);
-    pose_update_rates[2] = imu_angular_velocity;
+  // Pose covariance (required by robot_pose_ekf) TODO: publish realistic values
+  // Odometry yaw covariance must be much bigger than the covariance provided
+  // by the imu, as the later takes much better measures
+  odom.pose.covariance[0]  = 0.1;
+  odom.pose.covariance[7]  = 0.1;
+  odom.pose.covariance[35] = use_imu_heading ? 0.05 : 0.2;
+
+  odom.pose.covariance[14] = 1e10; // set a non-zero covariance on unused
+  odom.pose.covariance[21] = 1e10; // dimensions (z, pitch and roll); this
+  odom.pose.covariance[28] = 1e10; // is a requirement of robot_pose_ekf
+  odom_pool.init(odom);
+
+  nh.param("publish_rate/odom", odom_rate, 0.0);
+  if ( odom_rate > 0.0 ) {
+    ROS_INFO_STREAM("Kobuki : publishing odometry at " << odom_rate << " Hz [" << name << "].");
   }
 
-  //since all ros tf odometry is 6DOF we'll need a quaternion created from yaw
-  geometry_msgs::Quaternion odom_quat = tf::createQuaternionMsgFromYaw(pose.heading());
-
-  if ( ros::ok() ) {
-    publishTransform(odom_quat);
-    publishOdometry(odom_quat, pose_update_rates);
+  odom_publisher.advertise<nav_msgs::Odometry>(nh, "odom", 50); // topic name and queue size
+  if ( publish_tf ) {
+    // what tf's transform broadcaster does, but this way we know when nobody listens
+    tf_publisher.advertise<tf2_msgs::TFMessage>(nh, "/tf", 100);
   }
 }
 
-/*****************************************************************************
-** Private Implementation
-*****************************************************************************/
-
-void Odometry::publishTransform(const geometry_msgs::Quaternion &odom_quat)
+void Odometry::publishTransform(const OdometryState &state)
 {
-  if (publish_tf == false)
-    return;
+  // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
+  tf2_msgs::TFMessagePtr odom_tf = tf_pool.acquire();
+  geometry_msgs::TransformStamped &odom_trans = odom_tf->transforms[0];
 
-  odom_trans.header.stamp = ros::Time::now();
-  odom_trans.transform.translation.x = pose.x();
-  odom_trans.transform.translation.y = pose.y();
+  odom_trans.header.stamp = ros::Time(state.stamp);
+  odom_trans.transform.translation.x = state.x;
+  odom_trans.transform.translation.y = state.y;
   odom_trans.transform.translation.z = 0.0;
-  odom_trans.transform.rotation = odom_quat;
-  odom_broadcaster.sendTransform(odom_trans);
+  //since all ros tf odometry is 6DOF we'll need a quaternion created from yaw
+  odom_trans.transform.rotation = tf::createQuaternionMsgFromYaw(state.heading);
+  tf_publisher.publish(odom_tf);
 }
 
-void Odometry::publishOdometry(const geometry_msgs::Quaternion &odom_quat,
-                               const ecl::linear_algebra::Vector3d &pose_update_rates)
+void Odometry::publishOdometry(const OdometryState &state)
 {
-  // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
-  nav_msgs::OdometryPtr odom(new nav_msgs::Odometry);
+  // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature;
+  // frames and covariances are already filled in by the pool
+  nav_msgs::OdometryPtr odom = odom_pool.acquire();
 
   // Header
-  odom->header.stamp = ros::Time::now();
-  odom->header.frame_id = odom_frame;
-  odom->child_frame_id = base_frame;
+  odom->header.stamp = ros::Time(state.stamp);
 
   // Position
-  odom->pose.pose.position.x = pose.x();
-  odom->pose.pose.position.y = pose.y();
+  odom->pose.pose.position.x = state.x;
+  odom->pose.pose.position.y = state.y;
   odom->pose.pose.position.z = 0.0;
-  odom->pose.pose.orientation = odom_quat;
+  odom->pose.pose.orientation = tf::createQuaternionMsgFromYaw(state.heading);
 
   // Velocity
-  odom->twist.twist.linear.x = pose_update_rates[0];
-  odom->twist.twist.linear.y = pose_update_rates[1];
-  odom->twist.twist.angular.z = pose_update_rates[2];
-
-  // Pose covariance (required by robot_pose_ekf) TODO: publish realistic values
-  // Odometry yaw covariance must be much bigger than the covariance provided
-  // by the imu, as the later takes much better measures
-  odom->pose.covariance[0]  = 0.1;
-  odom->pose.covariance[7]  = 0.1;
-  odom->pose.covariance[35] = use_imu_heading ? 0.05 : 0.2;
-
-  odom->pose.covariance[14] = 1e10; // set a non-zero covariance on unused
-  odom->pose.covariance[21] = 1e10; // dimensions (z, pitch and roll); this
-  odom->pose.covariance[28] = 1e10; // is a requirement of robot_pose_ekf
+  odom->twist.twist.linear.x = state.linear_velocity;
+  odom->twist.twist.linear.y = state.lateral_velocity;
+  odom->twist.twist.angular.z = state.angular_velocity;
 
   odom_publisher.publish(odom);
 }
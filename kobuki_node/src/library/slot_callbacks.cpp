@@ -37,6 +37,7 @@
 ** Includes
 *****************************************************************************/
 
+#include <boost/static_assert.hpp>
 #include "kobuki_node/kobuki_ros.hpp"
 
 /*****************************************************************************
@@ -46,161 +47,280 @@
 namespace kobuki
 {
 
+/**
+ * @brief Handle a stream data packet from the driver.
+ *
+ * The driver data is copied into a snapshot once per packet and every
+ * publisher (and the diagnostics in update()) works from that copy.
+ *
+ * This runs in the driver thread that reads the serial port, so unless
+ * configured otherwise, the snapshot is only queued here and all the message
+ * building and publishing happens in the publishing thread.
+ */
 void KobukiRos::processStreamData() {
-  publishWheelState();
-  publishSensorState();
-  publishDockIRData();
-  publishInertia();
-  publishRawInertia();
+  if ( !startup.streamReady() ) {
+    // only the new driver's thread calls in here once startup began
+    startup.streamReceived(ros::WallTime::now().toSec());
+  }
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if ( !driverAvailable(driver_lock) ) {
+    return; // being replaced
+  }
+  if ( !driver_thread_configured ) {
+    // the driver owns this thread, first chance we get to configure it
+    thread_scheduling.apply("Driver");
+    driver_thread_configured = true;
+  }
+  StreamSnapshot &snapshot = stream_snapshots.back();
+  core.capture(*kobuki, snapshot);
+  stream_snapshots.commit();
+
+  // the driver sends this cycle's base control command right after this slot
+  checkCommandTimeout();
+  stepVelocitySmoother(snapshot);
+
+  // transitions are rare and must not be dropped with the queued snapshots, so check them right here
+  core.processHazards(snapshot, *this);
+  command_latency.motionMeasured(ros::WallTime::now().toSec(),
+                                 snapshot.pose_update_rates[0], snapshot.pose_update_rates[2]);
+
+  if ( !publish_threaded ) {
+    core.process(snapshot, *this);
+  } else if ( publish_queue.push(snapshot) ) {
+    { boost::mutex::scoped_lock lock(publish_mutex); } // publishing thread is either waiting or yet to check
+    publish_condition.notify_one();
+  }
 }
 
-/*****************************************************************************
-** Publish Sensor Stream Workers
-*****************************************************************************/
-
-void KobukiRos::publishSensorState()
+/**
+ * @brief Worker for the publishing thread, drains the snapshot queue.
+ */
+void KobukiRos::publishLoop()
 {
-  if ( ros::ok() ) {
-    if (sensor_state_publisher.getNumSubscribers() > 0) {
-      kobuki_msgs::SensorState state;
-      CoreSensors::Data data = kobuki.getCoreSensorData();
-      state.header.stamp = ros::Time::now();
-      state.time_stamp = data.time_stamp; // firmware time stamp
-      state.bumper = data.bumper;
-      state.wheel_drop = data.wheel_drop;
-      state.cliff = data.cliff;
-      state.left_encoder = data.left_encoder;
-      state.right_encoder = data.right_encoder;
-      state.left_pwm = data.left_pwm;
-      state.right_pwm = data.right_pwm;
-      state.buttons = data.buttons;
-      state.charger = data.charger;
-      state.battery = data.battery;
-      state.over_current = data.over_current;
-
-      Cliff::Data cliff_data = kobuki.getCliffData();
-      state.bottom = cliff_data.bottom;
-
-      Current::Data current_data = kobuki.getCurrentData();
-      state.current = current_data.current;
-
-      GpInput::Data gp_input_data = kobuki.getGpInputData();
-      state.digital_input = gp_input_data.digital_input;
-      for ( unsigned int i = 0; i < gp_input_data.analog_input.size(); ++i ) {
-        state.analog_input.push_back(gp_input_data.analog_input[i]);
+  thread_scheduling.apply("Publishing");
+  while ( !shutdown_requested.load(boost::memory_order_acquire) )
+  {
+    const StreamSnapshot *snapshot = publish_queue.front();
+    if ( snapshot == NULL )
+    {
+      boost::mutex::scoped_lock lock(publish_mutex);
+      while ( publish_queue.empty() && !shutdown_requested.load(boost::memory_order_acquire) )
+      {
+        publish_condition.wait(lock);
       }
+      continue;
+    }
+    core.process(*snapshot, *this);
+    publish_queue.pop();
+  }
+}
 
-      sensor_state_publisher.publish(state);
+/**
+ * @brief Stop the base if velocity commands stopped coming in.
+ *
+ * Checked for every stream packet in the driver thread, just before the
+ * driver sends the base control command of the cycle, so the stop goes out
+ * within one firmware cycle (20ms) of the deadline.
+ */
+void KobukiRos::checkCommandTimeout()
+{
+  boost::mutex::scoped_lock lock(base_control_mutex);
+  if ( core.commandTimeout().check(kobuki->isEnabled()) )
+  {
+    if ( velocity_smoother.enabled() )
+    {
+      velocity_smoother.stop(); // ramps down from the next step on
+    }
+    else
+    {
+      kobuki->setBaseControl(0, 0);
     }
+    ROS_WARN("Kobuki : Incoming velocity commands not received for more than %.2f seconds -> zero'ing velocity commands", core.commandTimeout().timeout());
+  }
+  // the active velocity input timing out lets the others through again
+  if ( velocity_mux.configured() && velocity_mux.update() )
+  {
+    publishActiveVelocityInput(VelocityMux::idle);
   }
 }
 
-void KobukiRos::publishWheelState()
+/**
+ * @brief Moves the smoothed velocity one step along, for the command about to go out.
+ */
+void KobukiRos::stepVelocitySmoother(const StreamSnapshot &snapshot)
 {
-  // Take latest encoders and gyro data
-  ecl::LegacyPose2D<double> pose_update;
-  ecl::linear_algebra::Vector3d pose_update_rates;
-  kobuki.updateOdometry(pose_update, pose_update_rates);
-  kobuki.getWheelJointStates(joint_states.position[0], joint_states.velocity[0],   // left wheel
-                             joint_states.position[1], joint_states.velocity[1]);  // right wheel
+  if ( !velocity_smoother.enabled() )
+  {
+    return;
+  }
+  boost::mutex::scoped_lock lock(base_control_mutex);
+  const double measured_linear = snapshot.pose_update_rates[0];
+  const double measured_angular = snapshot.pose_update_rates[2];
+  if ( !kobuki->isEnabled() )
+  {
+    // nothing to ramp, start from wherever the base is once enabled
+    velocity_smoother.reset(measured_linear, measured_angular);
+    return;
+  }
+  velocity_smoother.step(snapshot.stamp, measured_linear, measured_angular);
+  kobuki->setBaseControl(velocity_smoother.linear(), velocity_smoother.angular());
+}
 
-  // Update and publish odometry and joint states
-  odometry.update(pose_update, pose_update_rates, kobuki.getHeading(), kobuki.getAngularVelocity());
+/*****************************************************************************
+** Publish Sensor Stream Workers
+*****************************************************************************/
 
-  if (ros::ok())
-  {
-    joint_states.header.stamp = ros::Time::now();
-    joint_state_publisher.publish(joint_states);
+/**
+ * The core decides what gets published when (see kobuki_core.hpp), the
+ * workers below only fill in the messages.
+ */
+bool KobukiRos::subscribed(const StreamOutput::Type &output) const
+{
+  if ( !ros::ok() ) {
+    return false;
+  }
+  switch ( output ) {
+    case ( StreamOutput::SensorState ) : { return sensor_state_publisher.hasSubscribers(); }
+    case ( StreamOutput::CompactSensorState ) : { return compact_sensor_publisher.hasSubscribers(); }
+    case ( StreamOutput::JointState ) : { return joint_state_publisher.hasSubscribers(); }
+    case ( StreamOutput::Inertia ) : { return imu_data_publisher.hasSubscribers(); }
+    case ( StreamOutput::RawInertia ) : { return raw_imu_data_publisher.hasSubscribers() || raw_gyro_batch_publisher.hasSubscribers(); }
+    case ( StreamOutput::DockIR ) : { return dock_ir_publisher.hasSubscribers(); }
+    case ( StreamOutput::Odometry ) : { return odometry.odometrySubscribed(); }
+    case ( StreamOutput::Transform ) : { return odometry.transformSubscribed(); }
+    default : { return false; }
   }
 }
 
-void KobukiRos::publishInertia()
+void KobukiRos::publishSensorState(const StreamSnapshot &snapshot, const SensorStateWindow &window)
 {
-  if (ros::ok())
-  {
-    if (imu_data_publisher.getNumSubscribers() > 0)
-    {
-      // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
-      sensor_msgs::ImuPtr msg(new sensor_msgs::Imu);
+  // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
+  kobuki_msgs::SensorStatePtr state = sensor_state_pool.acquire();
+  const CoreSensors::Data &data = snapshot.core_sensors;
+  state->header.stamp = ros::Time(snapshot.stamp);
+  state->time_stamp = data.time_stamp; // firmware time stamp
+  state->bumper = window.bumper;
+  state->wheel_drop = window.wheel_drop;
+  state->cliff = window.cliff;
+  state->left_encoder = data.left_encoder;
+  state->right_encoder = data.right_encoder;
+  state->left_pwm = data.left_pwm;
+  state->right_pwm = data.right_pwm;
+  state->buttons = window.buttons;
+  state->charger = data.charger;
+  state->battery = data.battery;
+  state->over_current = window.over_current;
+
+  // arrays are pre-sized by the pool, so these just copy in place
+  state->bottom = window.bottom_min;   // closest to seeing a cliff in the window
+  state->current = window.current_max; // closest to stalling in the window
+  state->digital_input = snapshot.gp_input.digital_input;
+  state->analog_input = snapshot.gp_input.analog_input;
+
+  sensor_state_publisher.publish(state);
+}
 
-      msg->header.frame_id = "gyro_link";
-      msg->header.stamp = ros::Time::now();
+/**
+ * @brief Publish the same content as sensors/core, packed for low bandwidth links.
+ */
+void KobukiRos::publishCompactSensorState(const uint8_t *frame, const size_t &size)
+{
+  std_msgs::UInt8MultiArrayPtr msg = compact_sensor_pool.acquire();
+  msg->data.assign(frame, frame + size); // within the pooled capacity
+  compact_sensor_publisher.publish(msg);
+}
+
+void KobukiRos::publishJointState(const StreamSnapshot &snapshot)
+{
+  sensor_msgs::JointStatePtr msg = joint_state_pool.acquire();
+  msg->header.stamp = ros::Time(snapshot.stamp);
+  msg->position[0] = snapshot.wheel_left_position;   // left wheel
+  msg->velocity[0] = snapshot.wheel_left_velocity;
+  msg->position[1] = snapshot.wheel_right_position;  // right wheel
+  msg->velocity[1] = snapshot.wheel_right_velocity;
+  joint_state_publisher.publish(msg);
+}
 
-      msg->orientation = tf::createQuaternionMsgFromRollPitchYaw(0.0, 0.0, kobuki.getHeading());
+void KobukiRos::publishInertia(const StreamSnapshot &snapshot, const InertiaWindow &window)
+{
+  // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature;
+  // frame id and covariances are already filled in by the pool
+  sensor_msgs::ImuPtr msg = imu_data_pool.acquire();
 
-      // set a non-zero covariance on unused dimensions (pitch and roll); this is a requirement of robot_pose_ekf
-      // set yaw covariance as very low, to make it dominate over the odometry heading when combined
-      // 1: fill once, as its always the same;  2: using an invented value; cannot we get a realistic estimation?
-      msg->orientation_covariance[0] = DBL_MAX;
-      msg->orientation_covariance[4] = DBL_MAX;
-      msg->orientation_covariance[8] = 0.05;
+  msg->header.stamp = ros::Time(snapshot.stamp);
 
-      // fill angular velocity; we ignore acceleration for now
-      msg->angular_velocity.z = kobuki.getAngularVelocity();
+  msg->orientation = tf::createQuaternionMsgFromRollPitchYaw(0.0, 0.0, snapshot.heading);
 
-      // angular velocity covariance; useless by now, but robot_pose_ekf's
-      // roadmap claims that it will compute velocities in the future
-      msg->angular_velocity_covariance[0] = DBL_MAX;
-      msg->angular_velocity_covariance[4] = DBL_MAX;
-      msg->angular_velocity_covariance[8] = 0.05;
+  // fill angular velocity (averaged over the window); we ignore acceleration for now
+  msg->angular_velocity.z = window.angularVelocity();
 
-      imu_data_publisher.publish(msg);
-    }
-  }
+  imu_data_publisher.publish(msg);
 }
 
-void KobukiRos::publishRawInertia()
+void KobukiRos::publishRawInertia(const RawInertiaSamples &samples)
 {
-  if ( ros::ok() && (raw_imu_data_publisher.getNumSubscribers() > 0) )
+  BOOST_STATIC_ASSERT(kobuki_node::RawGyroBatch::CAPACITY == RawInertiaSamples::capacity);
+  if ( raw_gyro_batch_publisher.hasSubscribers() )
   {
-    // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
-    sensor_msgs::ImuPtr msg(new sensor_msgs::Imu);
-    ThreeAxisGyro::Data data = kobuki.getRawInertiaData();
-
-    ros::Time now = ros::Time::now();
-    ros::Duration interval(0.01); // Time interval between each sensor reading.
-    const double digit_to_dps = 0.00875; // digit to deg/s ratio, comes from datasheet of 3d gyro[L3G4200D].
-    unsigned int length = data.followed_data_length/3;
-    for( unsigned int i=0; i<length; i++) {
-      // Each sensor reading has id, that circulate 0 to 255.
-      //msg->header.frame_id = std::string("gyro_link_" + boost::lexical_cast<std::string>((unsigned int)data.frame_id+i));
-      msg->header.frame_id = "gyro_link";
-
-      // Update rate of 3d gyro sensor is 100 Hz, but robot's update rate is 50 Hz.
-      // So, here is some compensation.
-      // See also https://github.com/yujinrobot/kobuki/issues/216
-      msg->header.stamp = now - interval * (length-i-1);
-
-      // Sensing axis of 3d gyro is not match with robot. It is rotated 90 degree counterclockwise about z-axis.
-      msg->angular_velocity.x = angles::from_degrees( -digit_to_dps * (short)data.data[i*3+1] );
-      msg->angular_velocity.y = angles::from_degrees(  digit_to_dps * (short)data.data[i*3+0] );
-      msg->angular_velocity.z = angles::from_degrees(  digit_to_dps * (short)data.data[i*3+2] );
-
+    kobuki_node::RawGyroBatchPtr msg = raw_gyro_batch_pool.acquire();
+    msg->header.stamp = ros::Time(samples.packet_stamp);
+    msg->frame_id = samples.frame_id;
+    msg->size = static_cast<uint8_t>(samples.size);
+    for ( unsigned int i = 0; i < samples.size; ++i ) {
+      msg->stamps[i] = ros::Time(samples.stamp[i]);
+      msg->angular_velocity[i].x = samples.angular_velocity[i][0];
+      msg->angular_velocity[i].y = samples.angular_velocity[i][1];
+      msg->angular_velocity[i].z = samples.angular_velocity[i][2];
+    }
+    raw_gyro_batch_publisher.publish(msg);
+  }
+  if ( raw_imu_data_publisher.hasSubscribers() )
+  {
+    for ( unsigned int i = 0; i < samples.size; ++i ) {
+      // a message each, with zero-copy nodelet subscribers still holding on to the previous sample
+      sensor_msgs::ImuPtr msg = raw_imu_data_pool.acquire();
+      msg->header.stamp = ros::Time(samples.stamp[i]);
+      msg->angular_velocity.x = samples.angular_velocity[i][0];
+      msg->angular_velocity.y = samples.angular_velocity[i][1];
+      msg->angular_velocity.z = samples.angular_velocity[i][2];
       raw_imu_data_publisher.publish(msg);
     }
   }
 }
 
-void KobukiRos::publishDockIRData()
+void KobukiRos::publishDockIR(const StreamSnapshot &snapshot, const DockIRWindow &window)
 {
-  if (ros::ok())
-  {
-    if (dock_ir_publisher.getNumSubscribers() > 0)
-    {
-      DockIR::Data data = kobuki.getDockIRData();
+  // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
+  kobuki_msgs::DockInfraRedPtr msg = dock_ir_pool.acquire();
 
-      // Publish as shared pointer to leverage the nodelets' zero-copy pub/sub feature
-      kobuki_msgs::DockInfraRedPtr msg(new kobuki_msgs::DockInfraRed);
+  msg->header.stamp = ros::Time(snapshot.stamp);
 
-      msg->header.frame_id = "dock_ir_link";
-      msg->header.stamp = ros::Time::now();
+  msg->data[0] = window.docking[0];
+  msg->data[1] = window.docking[1];
+  msg->data[2] = window.docking[2];
 
-      msg->data.push_back( data.docking[0] );
-      msg->data.push_back( data.docking[1] );
-      msg->data.push_back( data.docking[2] );
+  dock_ir_publisher.publish(msg);
+}
 
-      dock_ir_publisher.publish(msg);
-    }
+/**
+ * @brief Publish the full hazard state whenever any bumper, cliff or wheel drop changes.
+ *
+ * Complements the individual event topics: every message carries the
+ * complete state and a sequence number, so consumers can detect lost
+ * messages and resync from a single message.
+ */
+void KobukiRos::publishHazardState(const HazardTransition &transition)
+{
+  if (ros::ok())
+  {
+    // transitions come in steady state too, so no allocation in the driver thread
+    kobuki_node::HazardStatePtr msg = hazard_state_pool.acquire();
+    msg->header.stamp = ros::Time(transition.stamp);
+    msg->hazards = transition.hazards;
+    msg->changed = transition.changed;
+    msg->sequence = transition.sequence;
+    msg->time_stamp = transition.time_stamp;
+    hazard_state_publisher.publish(msg);
   }
 }
 
@@ -215,6 +335,7 @@ void KobukiRos::publishDockIRData()
  */
 void KobukiRos::publishVersionInfo(const VersionInfo &version_info)
 {
+  startup.versionReceived(ros::WallTime::now().toSec());
   if (ros::ok())
   {
     kobuki_msgs::VersionInfoPtr msg(new kobuki_msgs::VersionInfo);
@@ -246,10 +367,11 @@ void KobukiRos::publishVersionInfo(const VersionInfo &version_info)
 
 void KobukiRos::publishControllerInfo()
 {
-  if (ros::ok())
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (ros::ok() && driverAvailable(driver_lock))
   {
     kobuki_msgs::ControllerInfoPtr msg(new kobuki_msgs::ControllerInfo);
-    ControllerInfo::Data data = kobuki.getControllerInfoData();
+    ControllerInfo::Data data = kobuki->getControllerInfoData();
 
     msg->type = data.type;
     msg->p_gain = static_cast<float>(data.p_gain) * 0.001f;;
@@ -397,6 +519,8 @@ void KobukiRos::publishRobotEvent(const RobotEvent &event)
 /**
  * @brief Prints the raw data stream to a publisher.
  *
+ * Recorded if the raw recorder is on.
+ *
  * This is a lazy publisher, it only publishes if someone is listening. It publishes the
  * hex byte values of the raw data commands. Useful for debugging command to protocol
  * byte packets to the firmware.
@@ -409,6 +533,11 @@ void KobukiRos::publishRobotEvent(const RobotEvent &event)
  */
 void KobukiRos::publishRawDataCommand(Command::Buffer &buffer)
 {
+  if ( record_raw ) {
+    const int64_t now = ros::WallTime::now().toNSec();
+    boost::mutex::scoped_lock lock(raw_recorder_mutex);
+    raw_recorder.record(RawRecordingFormat::Command, now, raw_firmware_stamp, buffer);
+  }
   if ( raw_data_command_publisher.getNumSubscribers() > 0 ) { // do not do string processing if there is no-one listening.
     std::ostringstream ostream;
     Command::Buffer::Formatter format;
@@ -424,6 +553,8 @@ void KobukiRos::publishRawDataCommand(Command::Buffer &buffer)
 /**
  * @brief Prints the raw data stream to a publisher.
  *
+ * Recorded if the raw recorder is on.
+ *
  * This is a lazy publisher, it only publishes if someone is listening. It publishes the
  * hex byte values of the raw data (incoming) stream. Useful for checking when bytes get
  * mangled.
@@ -436,6 +567,12 @@ void KobukiRos::publishRawDataCommand(Command::Buffer &buffer)
  */
 void KobukiRos::publishRawDataStream(PacketFinder::BufferType &buffer)
 {
+  if ( record_raw ) {
+    const int64_t now = ros::WallTime::now().toNSec();
+    boost::mutex::scoped_lock lock(raw_recorder_mutex);
+    rawPacketTimeStamp(buffer, raw_firmware_stamp); // keeps the last one if there is none
+    raw_recorder.record(RawRecordingFormat::Stream, now, raw_firmware_stamp, buffer);
+  }
   if ( raw_data_stream_publisher.getNumSubscribers() > 0 ) { // do not do string processing if there is no-one listening.
     /*std::cout << "size: [" << buffer.size() << "], asize: [" << buffer.asize() << "]" << std::endl;
     std::cout << "leader: " << buffer.leader << ", follower: " << buffer.follower  << std::endl;
@@ -471,6 +608,8 @@ void KobukiRos::publishRawDataStream(PacketFinder::BufferType &buffer)
 
 void KobukiRos::publishRawControlCommand(const std::vector<short> &velocity_commands)
 {
+  // emitted by the driver right after writing the base control command to the port
+  command_latency.commandSent(ros::WallTime::now().toSec());
   if ( raw_control_command_publisher.getNumSubscribers() > 0 ) {
     std_msgs::Int16MultiArrayPtr msg(new std_msgs::Int16MultiArray);
     msg->data = velocity_commands;
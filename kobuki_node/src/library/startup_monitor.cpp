@@ -0,0 +1,88 @@
+/**
+ * @file /src/library/startup_monitor.cpp
+ *
+ * @brief Driver readiness signalling implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <boost/thread/thread_time.hpp>
+#include "../../include/kobuki_node/startup_monitor.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation [StartupMonitor]
+*****************************************************************************/
+
+StartupMonitor::StartupMonitor() :
+  stream_ready(false),
+  version_ready(false),
+  started(0.0),
+  first_stream(0.0),
+  first_version(0.0)
+{}
+
+void StartupMonitor::start(const double &now) {
+  boost::mutex::scoped_lock lock(mutex);
+  stream_ready.store(false, boost::memory_order_relaxed);
+  version_ready = false;
+  started = now;
+}
+
+void StartupMonitor::streamReceived(const double &now) {
+  boost::mutex::scoped_lock lock(mutex);
+  if ( stream_ready.load(boost::memory_order_relaxed) ) {
+    return;
+  }
+  first_stream = now;
+  stream_ready.store(true, boost::memory_order_release);
+  condition.notify_all();
+}
+
+void StartupMonitor::versionReceived(const double &now) {
+  boost::mutex::scoped_lock lock(mutex);
+  if ( version_ready ) {
+    return;
+  }
+  first_version = now;
+  version_ready = true;
+  condition.notify_all();
+}
+
+bool StartupMonitor::waitUntilReady(const double &timeout) {
+  const boost::system_time deadline = boost::get_system_time()
+      + boost::posix_time::microseconds(static_cast<long>(timeout * 1000000.0));
+  boost::mutex::scoped_lock lock(mutex);
+  while ( !ready() ) {
+    if ( !condition.timed_wait(lock, deadline) ) {
+      return ready();
+    }
+  }
+  return true;
+}
+
+bool StartupMonitor::versionReady() const {
+  boost::mutex::scoped_lock lock(mutex);
+  return version_ready;
+}
+
+double StartupMonitor::timeToStream() const {
+  boost::mutex::scoped_lock lock(mutex);
+  return stream_ready.load(boost::memory_order_relaxed) ? first_stream - started : -1.0;
+}
+
+double StartupMonitor::timeToVersion() const {
+  boost::mutex::scoped_lock lock(mutex);
+  return version_ready ? first_version - started : -1.0;
+}
+
+} // namespace kobuki
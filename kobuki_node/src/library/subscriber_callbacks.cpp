@@ -52,15 +52,77 @@ namespace kobuki
 
 void KobukiRos::subscribeVelocityCommand(const geometry_msgs::TwistConstPtr msg)
 {
-  if (kobuki.isEnabled())
+  applyVelocityCommand(*msg, VelocityMux::idle);
+}
+
+void KobukiRos::subscribeVelocityStampedCommand(const geometry_msgs::TwistStampedConstPtr msg)
+{
+  // unstamped ones are taken as fresh, like on commands/velocity
+  if (!msg->header.stamp.isZero())
   {
-    // For now assuming this is in the robot frame, but probably this
-    // should be global frame and require a transform
-    //double vx = msg->linear.x;        // in (m/s)
-    //double wz = msg->angular.z;       // in (rad/s)
-    ROS_DEBUG_STREAM("Kobuki : velocity command received [" << msg->linear.x << "],[" << msg->angular.z << "]");
-    kobuki.setBaseControl(msg->linear.x, msg->angular.z);
-    odometry.resetTimeout();
+    const double age = (ros::Time::now() - msg->header.stamp).toSec();
+    if (!command_age.accept(age))
+    {
+      ROS_DEBUG_STREAM("Kobuki : dropped a velocity command stamped " << age << "s ago [" << name << "].");
+      return;
+    }
+  }
+  applyVelocityCommand(msg->twist, VelocityMux::idle);
+}
+
+void KobukiRos::subscribeMuxVelocityCommand(const geometry_msgs::TwistConstPtr msg, const unsigned int input)
+{
+  applyVelocityCommand(*msg, static_cast<int>(input));
+}
+
+/**
+ * @brief Hands a velocity command to the driver.
+ *
+ * @param msg : the command.
+ * @param mux_input : velocity mux input it came in on, idle without the mux.
+ */
+void KobukiRos::applyVelocityCommand(const geometry_msgs::Twist &msg, const int &mux_input)
+{
+  const double received = ros::WallTime::now().toSec();
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  const bool available = driverAvailable(driver_lock) && kobuki->isEnabled();
+  bool applied = false;
+  {
+    // can't interleave with the timeout check zero'ing this command
+    boost::mutex::scoped_lock lock(base_control_mutex);
+    // arbitrated even without a driver, so the active input is right once it is back
+    bool accepted = true;
+    if (mux_input != VelocityMux::idle)
+    {
+      const int previous = velocity_mux.active();
+      accepted = velocity_mux.commandReceived(static_cast<unsigned int>(mux_input));
+      if (velocity_mux.active() != previous)
+      {
+        publishActiveVelocityInput(velocity_mux.active());
+      }
+    }
+    if (accepted && available)
+    {
+      // For now assuming this is in the robot frame, but probably this
+      // should be global frame and require a transform
+      //double vx = msg.linear.x;        // in (m/s)
+      //double wz = msg.angular.z;       // in (rad/s)
+      ROS_DEBUG_STREAM("Kobuki : velocity command received [" << msg.linear.x << "],[" << msg.angular.z << "]");
+      if (velocity_smoother.enabled())
+      {
+        velocity_smoother.command(msg.linear.x, msg.angular.z); // reaches the driver with the next stream packet
+      }
+      else
+      {
+        kobuki->setBaseControl(msg.linear.x, msg.angular.z);
+      }
+      core.commandTimeout().commandReceived();
+      applied = true;
+    }
+  }
+  if (applied)
+  {
+    command_latency.commandApplied(received, ros::WallTime::now().toSec(), msg.linear.x, msg.angular.z);
   }
   return;
 }
@@ -68,11 +130,16 @@ void KobukiRos::subscribeVelocityCommand(const geometry_msgs::TwistConstPtr msg)
 
 void KobukiRos::subscribeLed1Command(const kobuki_msgs::LedConstPtr msg)
 {
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (!driverAvailable(driver_lock))
+  {
+    return; // disconnected
+  }
   switch( msg->value ) {
-  case kobuki_msgs::Led::GREEN:  kobuki.setLed(Led1, Green ); break;
-  case kobuki_msgs::Led::ORANGE: kobuki.setLed(Led1, Orange ); break; 
-  case kobuki_msgs::Led::RED:    kobuki.setLed(Led1, Red ); break;
-  case kobuki_msgs::Led::BLACK:  kobuki.setLed(Led1, Black ); break;
+  case kobuki_msgs::Led::GREEN:  kobuki->setLed(Led1, Green ); break;
+  case kobuki_msgs::Led::ORANGE: kobuki->setLed(Led1, Orange ); break; 
+  case kobuki_msgs::Led::RED:    kobuki->setLed(Led1, Red ); break;
+  case kobuki_msgs::Led::BLACK:  kobuki->setLed(Led1, Black ); break;
   default: ROS_WARN_STREAM("Kobuki : led 1 command value invalid."); break;
   }
   return;
@@ -80,11 +147,16 @@ void KobukiRos::subscribeLed1Command(const kobuki_msgs::LedConstPtr msg)
 
 void KobukiRos::subscribeLed2Command(const kobuki_msgs::LedConstPtr msg)
 {
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (!driverAvailable(driver_lock))
+  {
+    return; // disconnected
+  }
   switch( msg->value ) {
-  case kobuki_msgs::Led::GREEN:  kobuki.setLed(Led2, Green ); break;
-  case kobuki_msgs::Led::ORANGE: kobuki.setLed(Led2, Orange ); break;
-  case kobuki_msgs::Led::RED:    kobuki.setLed(Led2, Red ); break;
-  case kobuki_msgs::Led::BLACK:  kobuki.setLed(Led2, Black ); break;
+  case kobuki_msgs::Led::GREEN:  kobuki->setLed(Led2, Green ); break;
+  case kobuki_msgs::Led::ORANGE: kobuki->setLed(Led2, Orange ); break;
+  case kobuki_msgs::Led::RED:    kobuki->setLed(Led2, Red ); break;
+  case kobuki_msgs::Led::BLACK:  kobuki->setLed(Led2, Black ); break;
   default: ROS_WARN_STREAM("Kobuki : led 2 command value invalid."); break;
   }
   return;
@@ -92,12 +164,17 @@ void KobukiRos::subscribeLed2Command(const kobuki_msgs::LedConstPtr msg)
 
 void KobukiRos::subscribeDigitalOutputCommand(const kobuki_msgs::DigitalOutputConstPtr msg)
 {
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (!driverAvailable(driver_lock))
+  {
+    return; // disconnected
+  }
   DigitalOutput digital_output;
   for ( unsigned int i = 0; i < 4; ++i ) {
     digital_output.values[i] = msg->values[i];
     digital_output.mask[i] = msg->mask[i];
   }
-  kobuki.setDigitalOutput(digital_output);
+  kobuki->setDigitalOutput(digital_output);
   return;
 }
 
@@ -145,7 +222,11 @@ void KobukiRos::subscribeExternalPowerCommand(const kobuki_msgs::ExternalPowerCo
       digital_output.mask[i] = false;
     }
   }
-  kobuki.setExternalPower(digital_output);
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (driverAvailable(driver_lock))
+  {
+    kobuki->setExternalPower(digital_output);
+  }
   return;
 }
 
@@ -154,33 +235,38 @@ void KobukiRos::subscribeExternalPowerCommand(const kobuki_msgs::ExternalPowerCo
  */
 void KobukiRos::subscribeSoundCommand(const kobuki_msgs::SoundConstPtr msg)
 {
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (!driverAvailable(driver_lock))
+  {
+    return; // disconnected
+  }
   if ( msg->value == kobuki_msgs::Sound::ON )
   {
-    kobuki.playSoundSequence(On);
+    kobuki->playSoundSequence(On);
   }
   else if ( msg->value == kobuki_msgs::Sound::OFF )
   {
-    kobuki.playSoundSequence(Off);
+    kobuki->playSoundSequence(Off);
   }
   else if ( msg->value == kobuki_msgs::Sound::RECHARGE )
   {
-    kobuki.playSoundSequence(Recharge);
+    kobuki->playSoundSequence(Recharge);
   }
   else if ( msg->value == kobuki_msgs::Sound::BUTTON )
   {
-    kobuki.playSoundSequence(Button);
+    kobuki->playSoundSequence(Button);
   }
   else if ( msg->value == kobuki_msgs::Sound::ERROR )
   {
-    kobuki.playSoundSequence(Error);
+    kobuki->playSoundSequence(Error);
   }
   else if ( msg->value == kobuki_msgs::Sound::CLEANINGSTART )
   {
-    kobuki.playSoundSequence(CleaningStart);
+    kobuki->playSoundSequence(CleaningStart);
   }
   else if ( msg->value == kobuki_msgs::Sound::CLEANINGEND )
   {
-    kobuki.playSoundSequence(CleaningEnd);
+    kobuki->playSoundSequence(CleaningEnd);
   }
   else
   {
@@ -195,12 +281,13 @@ void KobukiRos::subscribeSoundCommand(const kobuki_msgs::SoundConstPtr msg)
 void KobukiRos::subscribeResetOdometry(const std_msgs::EmptyConstPtr /* msg */)
 {
   ROS_INFO_STREAM("Kobuki : Resetting the odometry. [" << name << "].");
-  joint_states.position[0] = 0.0; // wheel_left
-  joint_states.velocity[0] = 0.0;
-  joint_states.position[1] = 0.0; // wheel_right
-  joint_states.velocity[1] = 0.0;
-  odometry.resetOdometry();
-  kobuki.resetOdometry();
+  // joint states are republished from the driver's (reset) wheel states on the next packet
+  core.resetOdometry();
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (driverAvailable(driver_lock))
+  {
+    kobuki->resetOdometry();
+  }
   return;
 }
 
@@ -209,14 +296,26 @@ void KobukiRos::subscribeMotorPower(const kobuki_msgs::MotorPowerConstPtr msg)
   if (msg->state == kobuki_msgs::MotorPower::ON)
   {
     ROS_INFO_STREAM("Kobuki : Firing up the motors. [" << name << "]");
-    kobuki.enable();
-    odometry.resetTimeout();
+    DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+    boost::mutex::scoped_lock lock(base_control_mutex);
+    motors_enabled = true; // also restored when reconnecting
+    if (driverAvailable(driver_lock))
+    {
+      kobuki->enable();
+    }
+    core.commandTimeout().commandReceived();
   }
   else if (msg->state == kobuki_msgs::MotorPower::OFF)
   {
-    kobuki.disable();
+    DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+    boost::mutex::scoped_lock lock(base_control_mutex);
+    motors_enabled = false;
+    if (driverAvailable(driver_lock))
+    {
+      kobuki->disable();
+    }
     ROS_INFO_STREAM("Kobuki : Shutting down the motors. [" << name << "]");
-    odometry.resetTimeout();
+    core.commandTimeout().commandReceived();
   }
   else
   {
@@ -231,7 +330,12 @@ void KobukiRos::subscribeControllerInfoCommand(const kobuki_msgs::ControllerInfo
     ROS_ERROR_STREAM("Kobuki : All controller gains should be positive. [" << name << "]");
     return;
   }
-  kobuki.setControllerGain(msg->type,
+  DriverLock driver_lock(driver_mutex, boost::try_to_lock);
+  if (!driverAvailable(driver_lock))
+  {
+    return; // disconnected
+  }
+  kobuki->setControllerGain(msg->type,
                            static_cast<unsigned int>(msg->p_gain*1000.0f),
                            static_cast<unsigned int>(msg->i_gain*1000.0f),
                            static_cast<unsigned int>(msg->d_gain*1000.0f));
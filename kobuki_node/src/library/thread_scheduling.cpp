@@ -0,0 +1,147 @@
+/**
+ * @file /src/library/thread_scheduling.cpp
+ *
+ * @brief Real time scheduling and cpu affinity implementation.
+ *
+ * License: BSD
+ *   https://raw.github.com/yujinrobot/kobuki/hydro-devel/kobuki_node/LICENSE
+ **/
+/*****************************************************************************
+ ** Includes
+ *****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <sstream>
+#include "../../include/kobuki_node/thread_scheduling.hpp"
+
+/*****************************************************************************
+** Namespaces
+*****************************************************************************/
+
+namespace kobuki {
+
+/*****************************************************************************
+** Implementation
+*****************************************************************************/
+
+bool ThreadScheduling::init(const int &new_priority, const std::string &new_policy,
+                            const std::vector<int> &new_cpus, const bool &new_lock_memory) {
+  outcomes.clear();
+  failed_outcomes.clear();
+  if ( new_policy == "fifo" ) {
+    policy = Fifo;
+  } else if ( new_policy == "rr" ) {
+    policy = RoundRobin;
+  } else {
+    error_message = "unknown rt_policy '" + new_policy + "', expected 'fifo' or 'rr'";
+    return false;
+  }
+  const int max_priority = sched_get_priority_max(policy == Fifo ? SCHED_FIFO : SCHED_RR);
+  if ( new_priority < 0 || new_priority > max_priority ) {
+    std::ostringstream ostream;
+    ostream << "rt_priority " << new_priority << " out of range [0, " << max_priority << "]";
+    error_message = ostream.str();
+    return false;
+  }
+  const long number_of_cpus = sysconf(_SC_NPROCESSORS_CONF);
+  for ( unsigned int i = 0; i < new_cpus.size(); ++i ) {
+    if ( new_cpus[i] < 0 || new_cpus[i] >= number_of_cpus || new_cpus[i] >= CPU_SETSIZE ) {
+      std::ostringstream ostream;
+      ostream << "cpu " << new_cpus[i] << " in cpu_affinity doesn't exist, there are " << number_of_cpus;
+      error_message = ostream.str();
+      return false;
+    }
+  }
+  priority = new_priority;
+  cpus = new_cpus;
+  lock_memory = new_lock_memory;
+  return true;
+}
+
+void ThreadScheduling::lockMemory() {
+  if ( !lock_memory ) {
+    return;
+  }
+  std::string outcome("locked");
+  if ( mlockall(MCL_CURRENT | MCL_FUTURE) != 0 ) {
+    outcome = std::string("not locked (") + strerror(errno) + ")";
+  }
+  record("Memory", outcome, outcome != "locked");
+}
+
+void ThreadScheduling::apply(const std::string &thread_name) {
+  if ( !configured() ) {
+    return;
+  }
+  std::ostringstream outcome;
+  bool failed = false;
+
+  if ( priority > 0 ) {
+    sched_param parameters;
+    parameters.sched_priority = priority;
+    const int result = pthread_setschedparam(pthread_self(), (policy == Fifo) ? SCHED_FIFO : SCHED_RR, &parameters);
+    if ( result == 0 ) {
+      outcome << ((policy == Fifo) ? "SCHED_FIFO " : "SCHED_RR ") << priority;
+    } else {
+      outcome << "normal scheduling (" << strerror(result) << ")";
+      failed = true;
+    }
+  } else {
+    outcome << "normal scheduling";
+  }
+
+  if ( !cpus.empty() ) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for ( unsigned int i = 0; i < cpus.size(); ++i ) {
+      CPU_SET(cpus[i], &cpu_set);
+    }
+    outcome << ", cpus";
+    for ( unsigned int i = 0; i < cpus.size(); ++i ) {
+      outcome << ((i == 0) ? " " : ",") << cpus[i];
+    }
+    const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if ( result != 0 ) {
+      outcome << " not set (" << strerror(result) << ")";
+      failed = true;
+    }
+  }
+
+  record(thread_name, outcome.str(), failed);
+}
+
+bool ThreadScheduling::report(std::vector<std::pair<std::string, std::string> > &current_outcomes) {
+  mutex.lock();
+  current_outcomes = outcomes;
+  const bool succeeded = std::find(failed_outcomes.begin(), failed_outcomes.end(), true) == failed_outcomes.end();
+  mutex.unlock();
+  return succeeded;
+}
+
+/*****************************************************************************
+** Private Implementation
+*****************************************************************************/
+
+void ThreadScheduling::record(const std::string &name, const std::string &outcome, const bool &failed) {
+  mutex.lock();
+  unsigned int i = 0;
+  while ( (i < outcomes.size()) && (outcomes[i].first != name) ) {
+    ++i;
+  }
+  if ( i == outcomes.size() ) {
+    outcomes.push_back(std::make_pair(name, outcome));
+    failed_outcomes.push_back(failed);
+  } else {
+    outcomes[i].second = outcome;
+    failed_outcomes[i] = failed;
+  }
+  mutex.unlock();
+}
+
+} // namespace kobuki
@@ -60,7 +60,8 @@ public:
     NODELET_DEBUG_STREAM("Kobuki : initialising nodelet...");
     std::string nodelet_name = this->getName();
     kobuki_.reset(new KobukiRos(nodelet_name));
-    // if there are latency issues with callbacks, we might want to move to process callbacks in multiple threads (use MTPrivateNodeHandle)
+    // velocity and motor power commands get their own queue and spinner inside KobukiRos,
+    // everything else is fine on the nodelet's single threaded queue
     if (kobuki_->init(this->getPrivateNodeHandle(), this->getNodeHandle()))
     {
       update_thread_.start(&KobukiNodelet::update, *this);
@@ -74,6 +75,7 @@ public:
 private:
   void update()
   {
+    kobuki_->configureThread("Update");
     ros::Rate spin_rate(10);
     while (!shutdown_requested_ && ros::ok() && kobuki_->update())
     {